@@ -8,20 +8,89 @@
 #include <algorithm>
 #include <fstream>
 #include <climits>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cstddef>
+#include <new>
+#include <memory>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#include <cstdlib>
 #include <string>
+#include <sstream>
+#include <random>
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 600;
 const int GRID_SIZE = 40;
-const int ROWS = SCREEN_HEIGHT / GRID_SIZE;
+const int ROWS = SCREEN_HEIGHT / GRID_SIZE; // Default map size; loaded layouts may be larger
 const int COLS = SCREEN_WIDTH / GRID_SIZE;
 const int ROBOT_RADIUS = GRID_SIZE / 3;
+const double SIM_TICK_SECONDS = 1.0 / 60.0;   // Fixed simulation step; robot moves 2 px per tick
+const double TARGET_FRAME_SECONDS = 1.0 / 60.0; // Frame pacing target when vsync is unavailable
+const double MAX_CATCHUP_SECONDS = 0.25;      // Longest stall the simulation will catch up on
+const double MIN_ZOOM = 0.002;  // Screen pixels per world unit (one cell is GRID_SIZE world units)
+const double MAX_ZOOM = 4.0;
+const int MIN_GRID_LINE_SPACING = 4; // Grid lines are skipped once cells shrink below this many pixels
+const double LOD_CELL_PIXELS = 2.0;  // Below this cell size obstacles are drawn from the occupancy pyramid
 
 // Global SDL variables
 SDL_Window* window = nullptr;
 SDL_Renderer* renderer = nullptr;
+bool vsyncActive = false; // Present blocks on the display refresh, so no manual pacing is needed
+SDL_Surface* offscreenSurface = nullptr; // Headless mode: software renderer draws straight into this
 TTF_Font* font = nullptr; // For on-screen text
 
+// Glyph atlas: printable ASCII rasterized once into a single texture
+const int ATLAS_FIRST_GLYPH = 32;
+const int ATLAS_LAST_GLYPH = 126;
+const int ATLAS_WIDTH = 512;
+
+struct GlyphInfo {
+    SDL_Rect src;  // Glyph cell inside the atlas texture
+    int advance;   // Horizontal pen advance in pixels
+};
+
+struct GlyphAtlas {
+    SDL_Texture* texture = nullptr;
+    GlyphInfo glyphs[ATLAS_LAST_GLYPH - ATLAS_FIRST_GLYPH + 1];
+    std::vector<SDL_Vertex> vertices; // Reused between draws
+    std::vector<int> indices;
+};
+
+// A whole-string texture that is re-rendered only when its content changes
+struct TextLabel {
+    std::string text;
+    SDL_Color color = {0, 0, 0, 0};
+    SDL_Texture* texture = nullptr;
+    int w = 0, h = 0;
+};
+
+GlyphAtlas glyphAtlas;
+TextLabel instructionLabels[7];
+
 // Flag to toggle between BFS and A* pathfinding
 bool useAStar = false;
 
@@ -65,74 +134,1102 @@ struct Robot {
     }
 };
 
+// A read-only file mapped copy-on-write: untouched pages stay shared with the page cache (and
+// other processes mapping the same file); pages written by this process become private copies.
+// So the file must only be replaced by rename, as writeFileAtomic does: writing it in place shows
+// through in the untouched pages without a gridVersion bump, and truncating it raises SIGBUS.
+struct MappedFile {
+    unsigned char* base = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    ~MappedFile();
+};
+
+// Occupancy grid stored row-major in one block; grid[y][x] indexes it like a 2D array
+struct Grid {
+    int rows, cols;
+    std::vector<unsigned char> cells; // 0: Free, 1: Obstacle
+    std::vector<unsigned char> costs; // Optional extra step cost per cell; empty when the map has none
+
+    // Set when the cells (and costs) live in a mapped layout file instead of the vectors above
+    std::shared_ptr<MappedFile> mapping;
+    unsigned char* mappedCells = nullptr;
+    const unsigned char* mappedCosts = nullptr;
+
+    Grid(int r, int c) : rows(r), cols(c), cells((size_t)r * c, 0) {}
+
+    unsigned char* data() { return mapping ? mappedCells : cells.data(); }
+    const unsigned char* data() const { return mapping ? mappedCells : cells.data(); }
+    const unsigned char* costData() const {
+        return mapping ? mappedCosts : costs.empty() ? nullptr : costs.data();
+    }
+
+    unsigned char* operator[](int y) { return data() + (size_t)y * cols; }
+    const unsigned char* operator[](int y) const { return data() + (size_t)y * cols; }
+
+    int cost(int x, int y) const {
+        const unsigned char* c = costData();
+        return c ? c[(size_t)y * cols + x] : 0;
+    }
+};
+
+// View transform. World units are the robot's pixel space (GRID_SIZE per cell);
+// zoom is the number of screen pixels per world unit.
+struct Camera {
+    double x = 0, y = 0; // World position of the screen's top-left corner
+    double zoom = 1.0;
+
+    double toScreenX(double wx) const { return (wx - x) * zoom; }
+    double toScreenY(double wy) const { return (wy - y) * zoom; }
+    int toCellX(int sx) const { return (int)std::floor((x + sx / zoom) / GRID_SIZE); }
+    int toCellY(int sy) const { return (int)std::floor((y + sy / zoom) / GRID_SIZE); }
+    double cellPixels() const { return GRID_SIZE * zoom; }
+
+    // Zoom by factor while keeping the world point under (sx, sy) fixed on screen
+    void zoomAt(int sx, int sy, double factor) {
+        double wx = x + sx / zoom;
+        double wy = y + sy / zoom;
+        zoom = std::max(MIN_ZOOM, std::min(MAX_ZOOM, zoom * factor));
+        x = wx - sx / zoom;
+        y = wy - sy / zoom;
+    }
+
+    void pan(double dxScreen, double dyScreen) {
+        x -= dxScreen / zoom;
+        y -= dyScreen / zoom;
+    }
+};
+
+// Half-open rectangle of cells [x0, x1) x [y0, y1)
+struct CellRange {
+    int x0, y0, x1, y1;
+};
+
 // Global simulation variables
-std::vector<std::vector<int>> warehouseGrid(ROWS, std::vector<int>(COLS, 0)); // 0: Free, 1: Obstacle
+Grid warehouseGrid(ROWS, COLS);
+Camera camera;
 Robot robot(0, 0);
 Point destination(0, 0);
 bool hasDestination = false;
 
+// Grid change journal: every edit bumps the version and is logged, so each cached view
+// can catch up on just the cells it missed since the version it last drew
+struct GridChange {
+    unsigned long long version;
+    Point cell;
+};
+
+unsigned long long gridVersion = 0;
+unsigned long long gridResetVersion = 0; // Last whole-grid change (e.g. layout load)
+std::vector<GridChange> gridJournal;     // Oldest entries are trimmed past GRID_JOURNAL_LIMIT
+const size_t GRID_JOURNAL_LIMIT = 4096;
+const size_t MAX_PATCHED_CELLS = 256;    // Beyond this a full redraw is cheaper
+const unsigned long long VIEW_INVALID = ULLONG_MAX; // Version of a cached view that must redraw fully
+
+// Background render target holding grid lines and obstacles
+struct StaticLayer {
+    SDL_Texture* texture = nullptr;
+    unsigned long long version = VIEW_INVALID;
+    double cameraX = 0, cameraY = 0, cameraZoom = 0; // View the texture was drawn with
+};
+
+StaticLayer staticLayer;
+
+// Mip-style occupancy pyramid. A cell at level k covers 2^k x 2^k grid cells and stores the
+// blocked fraction scaled to 0..255; level 0 is the grid itself and has no stored data.
+// Levels are built top to bottom a few rows per frame, so a freshly mapped huge map is not
+// read in full on the first zoomed-out frame; rows not built yet are drawn as empty floor.
+const size_t PYRAMID_CELLS_PER_FRAME = 1 << 22; // Grid cells reduced into level 1 per frame
+
+struct OccupancyPyramid {
+    struct Level {
+        int rows = 0, cols = 0;
+        int rowsBuilt = 0; // Rows [0, rowsBuilt) hold valid coverage
+        std::vector<unsigned char> coverage;
+    };
+    std::vector<Level> levels;
+};
+
+OccupancyPyramid occupancyPyramid;
+SDL_Texture* lodTexture = nullptr; // Streaming texture, one texel per pyramid cell on screen
+
+// Texture render mode: the map is split into tiles, each a streaming texture with one texel per
+// cell. Tiles are created when first visible and only their dirty rows are re-uploaded.
+const int CELL_TILE_SIZE = 1024;
+
+struct CellTile {
+    SDL_Texture* texture = nullptr;
+    int dirtyMin = INT_MAX, dirtyMax = -1; // Texel rows waiting for upload, inclusive
+};
+
+struct CellTextureLayer {
+    int tilesX = 0, tilesY = 0;
+    std::vector<CellTile> tiles;
+    unsigned long long version = VIEW_INVALID;
+};
+
+CellTextureLayer cellLayer;
+bool useCellTextures = false; // V toggles between rect drawing and cell textures
+
+// Lock-free single-producer/single-consumer ring. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+struct SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+    T items[Capacity];
+    std::atomic<size_t> head{0}; // Next slot the producer writes
+    std::atomic<size_t> tail{0}; // Next slot the consumer reads
+
+    bool push(const T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == Capacity) return false;
+        items[h & (Capacity - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    bool pop(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        item = items[t & (Capacity - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// Search expansion events, emitted by the planners and animated by the renderer
+enum SearchEventType : unsigned char { SEARCH_BEGIN, SEARCH_OPENED, SEARCH_CLOSED };
+
+struct SearchEvent {
+    int x, y;
+    SearchEventType type;
+};
+
+// Instrumentation policies for the search kernels. NullSearchTracer's hooks are empty inlines,
+// so the untraced planner instantiations contain no instrumentation at all.
+// reopened: a queued cell got a cheaper cost; queued: open list size after a push;
+// allocated: bytes of per-cell bookkeeping; finished: path length (0 when none was found).
+struct NullSearchTracer {
+    void begin() {}
+    void opened(int, int) {}
+    void closed(int, int) {}
+    void reopened(int, int) {}
+    void queued(size_t, size_t) {}
+    void allocated(size_t) {}
+    void finished(size_t) {}
+};
+
+struct RingSearchTracer {
+    void begin() { emit({0, 0, SEARCH_BEGIN}); }
+    void opened(int x, int y) { emit({x, y, SEARCH_OPENED}); }
+    void closed(int x, int y) { emit({x, y, SEARCH_CLOSED}); }
+    void reopened(int, int) {}
+    void queued(size_t, size_t) {}
+    void allocated(size_t) {}
+    void finished(size_t) {}
+    void emit(const SearchEvent& ev);
+};
+
+// What one search did. allocationBytes is estimated from container sizes: the per-cell arrays
+// plus the open list at its peak.
+struct SearchStats {
+    size_t expanded = 0, generated = 0, reopened = 0;
+    size_t queuePeak = 0, pathLength = 0, allocationBytes = 0;
+    double seconds = 0;
+};
+
+struct SearchStatsTracer {
+    SearchStats stats;
+    size_t queueBytes = 0;
+    Uint64 startCounter = 0;
+    void begin() {
+        stats = SearchStats();
+        queueBytes = 0;
+        startCounter = SDL_GetPerformanceCounter();
+    }
+    void opened(int, int) { ++stats.generated; }
+    void closed(int, int) { ++stats.expanded; }
+    void reopened(int, int) { ++stats.reopened; }
+    void queued(size_t size, size_t entryBytes) {
+        if (size > stats.queuePeak) {
+            stats.queuePeak = size;
+            queueBytes = size * entryBytes;
+        }
+    }
+    void allocated(size_t bytes) { stats.allocationBytes += bytes; }
+    void finished(size_t pathLength) {
+        stats.seconds = (double)(SDL_GetPerformanceCounter() - startCounter) / SDL_GetPerformanceFrequency();
+        stats.pathLength = pathLength;
+        stats.allocationBytes += queueBytes;
+    }
+};
+
+// Feeds every hook to two tracers, e.g. the expansion animation and the stats collector
+template <typename A, typename B>
+struct TeeSearchTracer {
+    A& a;
+    B& b;
+    void begin() { a.begin(); b.begin(); }
+    void opened(int x, int y) { a.opened(x, y); b.opened(x, y); }
+    void closed(int x, int y) { a.closed(x, y); b.closed(x, y); }
+    void reopened(int x, int y) { a.reopened(x, y); b.reopened(x, y); }
+    void queued(size_t size, size_t entryBytes) { a.queued(size, entryBytes); b.queued(size, entryBytes); }
+    void allocated(size_t bytes) { a.allocated(bytes); b.allocated(bytes); }
+    void finished(size_t pathLength) { a.finished(pathLength); b.finished(pathLength); }
+};
+
+// Per-algorithm search histograms, log2-bucketed: bucket i holds values in [2^(i-1), 2^i)
+const int SEARCH_HISTOGRAM_BUCKETS = 40;
+
+struct SearchHistogram {
+    unsigned long long queries = 0;
+    unsigned long long micros[SEARCH_HISTOGRAM_BUCKETS] = {};   // Wall time in microseconds
+    unsigned long long expanded[SEARCH_HISTOGRAM_BUCKETS] = {};
+    size_t queuePeak = 0;        // Largest open list over all searches
+    unsigned long long reopened = 0;
+    SearchStats last;
+};
+
+// Per-cell traffic counters; readers sum the shards on demand. A recording thread claims a shard
+// of its own and increments it with a relaxed load/store (no locked read-modify-write). When all
+// are taken it falls back to the last shard, which is shared and always uses fetch_add. A shard's
+// counters are allocated on its first record, so a map only the simulation thread drives pays for
+// one shard: 6 bytes per cell.
+const int TRAFFIC_SHARDS = 4;
+const int TRAFFIC_SHARED_SHARD = TRAFFIC_SHARDS - 1;
+const int WAIT_FRAMES_PER_VISIT = 30;   // Wait frames that weigh as much as one visit in the heat score
+const int HEAT_PER_PENALTY_STEP = 4;    // Heat needed for each extra step of congestion cost
+const int MAX_CONGESTION_PENALTY = 8;
+const int HEATMAP_REFRESH_FRAMES = 10;  // Overlay re-merges the shards this often
+
+struct TrafficShard {
+    std::vector<std::atomic<unsigned int>> visits;
+    std::vector<std::atomic<unsigned short>> waitFrames; // Saturates after about 18 minutes in one cell
+    std::atomic<bool> allocated{false};    // Counters sized for the map; readers skip the shard until set
+    std::mutex allocating;                 // Two threads can reach the shared shard first at once
+    std::atomic<unsigned int> peakHeat{0}; // Highest heat this shard has seen in one cell
+    std::atomic<unsigned int> writes{0};   // Bumped on every record so readers can spot changes
+    std::atomic<bool> owned{false};        // Claimed by a live thread; never set on the shared shard
+
+    static void bump(std::atomic<unsigned int>& counter, bool exclusive) {
+        if (exclusive)
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        else
+            counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void bump(std::atomic<unsigned short>& counter, bool exclusive) {
+        unsigned short value = counter.load(std::memory_order_relaxed);
+        if (exclusive) {
+            if (value < USHRT_MAX) counter.store(value + 1, std::memory_order_relaxed);
+        } else {
+            while (value < USHRT_MAX && !counter.compare_exchange_weak(value, value + 1, std::memory_order_relaxed)) {}
+        }
+    }
+};
+
+struct TrafficHeatmap {
+    int rows = 0, cols = 0;
+    TrafficShard shards[TRAFFIC_SHARDS];
+};
+
+// A thread's shard, released for reuse when the thread exits
+struct TrafficShardOwner {
+    TrafficShard* shard = nullptr;
+    bool exclusive = false;
+    ~TrafficShardOwner() {
+        if (exclusive) shard->owned.store(false, std::memory_order_release);
+    }
+};
+
+thread_local TrafficShardOwner trafficShardOwner;
+
+// Colour-mapped overlay covering the visible cells; only rows whose colours changed are uploaded
+struct HeatmapOverlay {
+    SDL_Texture* texture = nullptr;
+    std::vector<Uint32> texels; // Last uploaded colours, one per visible cell
+    CellRange window = {0, 0, 0, 0};
+    int framesUntilRefresh = 0;
+    unsigned int mergedWrites = 0; // Shard write total at the last refresh
+};
+
+TrafficHeatmap traffic;
+HeatmapOverlay heatmapOverlay;
+bool showHeatmap = false;       // H toggles the overlay
+bool useCongestionCost = false; // C makes A* route around busy cells
+
+unsigned long long simTick = 0; // Fixed-step simulation ticks since startup
+
+// Command-line options
+struct Options {
+    bool headless = false;    // Software rendering into an offscreen surface, no window
+    int frames = 0;           // Quit after this many frames (0: run until closed)
+    std::string capturePath;  // Frame capture: BMP file prefix, or a .raw BGRA stream
+    std::string layoutPath;   // Layout loaded at startup
+    bool hasGoal = false;
+    Point goal;               // Destination set at startup
+    std::string scenarioPath; // MovingAI .scen file: run the benchmark and exit
+    bool watchLayout = false; // Hot-reload the layout file (--layout, or the text export) when it changes
+    std::string recordPath;   // Input log written during the session
+    std::string replayPath;   // Input log fed back instead of live input
+    std::string pathExportPath; // Binary log of every planned path
+    std::string tracePath;    // Record spans from startup and write them here on exit
+    std::string convertPath;  // Write the --layout file here in the format its extension picks, and exit
+};
+
+// Frame capture. The render thread copies each finished frame into a pooled buffer and a
+// writer thread encodes it, so capturing costs the render thread one memcpy.
+const int CAPTURE_POOL_SIZE = 8;
+
+struct CapturedFrame {
+    unsigned long long index;
+    std::vector<Uint8> pixels; // ARGB8888, tightly packed
+};
+
+struct FrameCapture {
+    bool active = false;
+    bool raw = false;          // One .raw stream instead of numbered BMP files
+    std::string path;
+    std::ofstream rawStream;
+    std::vector<std::vector<Uint8>> freeBuffers;
+    int buffersAllocated = 0;
+    std::deque<CapturedFrame> queue;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread writer;
+    bool stopping = false;
+    unsigned long long framesCaptured = 0;
+};
+
+FrameCapture frameCapture;
+
+// Background layout saves: the event loop queues a snapshot of the grid and returns; the writer
+// thread encodes it, writes a temporary file, syncs it to disk and renames it over the target.
+struct SaveJob {
+    Grid snapshot;
+    std::string filename;
+    bool compactJournal = false;
+    size_t journalRecords = 0;          // Journal records (since attaching) folded into the snapshot
+    bool startJournal = false;          // First save of LAYOUT_FILE: create the journal against it
+    bool loadJournaled = false;         // Not a save: read LAYOUT_FILE and its journal, after earlier saves
+
+    SaveJob(const std::string& file = "") : snapshot(0, 0), filename(file) {}
+};
+
+struct LayoutSaver {
+    std::deque<SaveJob> jobs;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread writer;
+    bool stopping = false;
+    int pending = 0;           // Queued or being written
+    std::string status;        // Last result, shown in the HUD
+    Uint32 statusTicks = 0;
+};
+
+LayoutSaver layoutSaver;
+const Uint32 SAVE_STATUS_MS = 3000; // How long a finished save stays in the HUD
+
+// Append-only journal of obstacle edits to LAYOUT_FILE, so edits survive a crash without rewriting
+// the map. File: "WHJL" | u32 base CRC | u32 next CRC | records. Each 16-byte record is
+// u32 x | u32 y | u8 value | 3 pad | u32 CRC-32 of the first 12 bytes; a torn tail is ignored.
+// Records are absolute assignments, so replaying the whole journal onto a base that already
+// contains a prefix of it gives the same grid. That lets compaction write the new base first and
+// trim the journal afterwards: while it runs, "next CRC" names the base being written, and the
+// journal applies to either.
+struct LayoutJournal {
+    std::mutex mutex;          // Appends on the event loop, trimming on the save writer
+    FILE* file = nullptr;      // Open for append while edits are journaled
+    size_t records = 0;        // In the file
+    size_t trimmed = 0;        // Dropped from the front of the file by compaction since attaching
+    bool compacting = false;
+    bool starting = false;     // The first save is being written; the file opens once it has a CRC
+    std::vector<unsigned char> pending; // Records made while starting, written after the header
+};
+
+LayoutJournal layoutJournal;
+
+// Loading LAYOUT_FILE is queued on the save writer behind any save or compaction in flight, so the
+// base and journal it reads are consistent without the event loop waiting for them
+struct JournaledLoad {
+    bool queued = false;       // Event loop only: the writer hasn't handed the layout over yet
+    bool saveAfter = false;    // Event loop only: S was pressed meanwhile; saved once the load lands
+    bool ready = false;        // The rest is guarded by layoutSaver.mutex
+    bool ok = false;
+    Grid grid{0, 0};           // Base with the journal replayed onto it
+    FILE* journal = nullptr;   // Reopened for append, installed when the grid is
+    size_t records = 0;
+};
+
+JournaledLoad journaledLoad;
+const char JOURNAL_MAGIC[4] = {'W', 'H', 'J', 'L'};
+const int JOURNAL_HEADER_BYTES = 12;
+const int JOURNAL_RECORD_BYTES = 16;
+const size_t JOURNAL_COMPACT_RECORDS = 4096; // Fold the journal into the base after this many edits
+
+SpscRing<SearchEvent, 1 << 20> searchEvents;
+size_t searchEventsDropped = 0;   // Events lost because the ring was full
+bool showSearch = false;          // E toggles expansion animation
+int searchEventsPerFrame = 64;    // Animation rate, adjusted with [ and ]
+std::vector<unsigned char> searchOverlay; // Per cell: 0 untouched, 1 open, 2 closed
+bool collectSearchStats = true;    // I toggles per-search statistics and their HUD line
+SearchHistogram searchHistograms[2]; // [0] BFS, [1] A*
+
+// Frame profiler: exclusive time per main-loop stage for the most recent frames. Switching
+// stage costs one performance-counter read; time spent waiting is charged to PROFILE_IDLE,
+// which is not recorded.
+enum ProfileStage {
+    PROFILE_EVENTS, PROFILE_PLAN, PROFILE_MOVE, PROFILE_GRID, PROFILE_OBSTACLES, PROFILE_OVERLAYS,
+    PROFILE_TEXT, PROFILE_PRESENT, PROFILE_STAGES, PROFILE_IDLE = PROFILE_STAGES
+};
+const char* const PROFILE_STAGE_NAMES[] = {"events", "plan", "move", "grid", "obstacles", "overlays", "text", "present"};
+const SDL_Color PROFILE_STAGE_COLORS[] = {
+    {230, 90, 90, 255}, {240, 170, 60, 255}, {230, 230, 90, 255}, {120, 200, 90, 255},
+    {80, 200, 200, 255}, {90, 140, 240, 255}, {170, 110, 230, 255}, {200, 200, 200, 255},
+};
+const int PROFILE_FRAMES = 240;              // One pixel column each in the overlay graph
+const double PROFILE_GRAPH_MS = 33.3;        // Overlay graph height in milliseconds
+
+struct FrameProfiler {
+    Uint64 frames[PROFILE_FRAMES][PROFILE_STAGES] = {}; // Ring of finished frames, in counter ticks
+    int head = 0, count = 0;
+    Uint64 current[PROFILE_STAGES + 1] = {};            // Frame in progress, plus the idle slot
+    int active = PROFILE_IDLE;
+    Uint64 stageStart = 0;
+    Uint64 frameStart = 0;                               // When the frame in progress left idle
+    bool visible = false;                                // P toggles the overlay
+    std::vector<Uint64> scratch;                         // Percentile workspace
+    std::vector<SDL_Rect> bars[PROFILE_STAGES];
+};
+
+FrameProfiler frameProfiler;
+
+// Charges the elapsed time to the active stage and makes `stage` active; returns the previous one
+int profileStage(int stage);
+
+// Times a nested stage (planning, text, ...) and hands the clock back to the enclosing one
+struct ProfileScope {
+    int parent;
+    explicit ProfileScope(int stage) : parent(profileStage(stage)) {}
+    ~ProfileScope() { profileStage(parent); }
+};
+
+// Span tracing for offline investigation. While recording is on, instrumented spans go into a
+// per-thread lock-free ring; flushing drains the rings into Chrome trace-event JSON, which
+// Perfetto and chrome://tracing open. Each ring is fixed-size and spans that do not fit are
+// dropped and counted, so memory stays bounded. Span names must be string literals.
+struct TraceSpan {
+    const char* name;
+    Uint64 begin, end; // Performance-counter ticks
+};
+
+const size_t TRACE_SPANS_PER_THREAD = 1 << 16;
+
+struct TraceBuffer {
+    SpscRing<TraceSpan, TRACE_SPANS_PER_THREAD> spans; // Written by the owning thread, drained by flushes
+    std::atomic<size_t> dropped{0};
+    std::atomic<bool> owned{false};  // A live thread writes here; released when it exits
+    const char* threadName = "";
+    int tid = 0;
+};
+
+struct SpanTrace {
+    std::atomic<bool> recording{false};
+    std::mutex mutex;                                  // Buffer registration and flushes
+    std::vector<std::unique_ptr<TraceBuffer>> buffers; // One per live thread, reused by later threads
+    Uint64 origin = 0;                                 // Counter value at timestamp 0
+    std::string path = "trace.json";
+};
+
+SpanTrace spanTrace;
+thread_local const char* traceThreadName = "worker"; // Long-lived threads name themselves
+
+// Releases the thread's buffer for reuse when the thread exits
+struct TraceBufferOwner {
+    TraceBuffer* buffer = nullptr;
+    ~TraceBufferOwner() {
+        if (buffer) buffer->owned.store(false, std::memory_order_release);
+    }
+};
+
+thread_local TraceBufferOwner traceBufferOwner;
+
+void traceSpan(const char* name, Uint64 begin, Uint64 end);
+
+// Records its lifetime as a span; costs one relaxed load when recording is off
+struct TraceScope {
+    const char* name;
+    Uint64 begin;
+    explicit TraceScope(const char* spanName)
+        : name(spanName),
+          begin(spanTrace.recording.load(std::memory_order_relaxed) ? SDL_GetPerformanceCounter() : 0) {}
+    ~TraceScope() {
+        if (begin) traceSpan(name, begin, SDL_GetPerformanceCounter());
+    }
+};
+
+// HDR-style latency histograms in nanoseconds. Each power of two is split into 16 linear
+// sub-buckets, so any recorded value is known to within 1/16 of itself from nanoseconds to days.
+// Recording is a relaxed atomic add from any thread. Histograms are merged by summing buckets.
+const int LATENCY_SUB_BITS = 4;
+const int LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BITS;
+const int LATENCY_MAGNITUDES = 48; // Values up to 2^48 ns, about three days
+const int LATENCY_BUCKETS = (LATENCY_MAGNITUDES - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS;
+
+struct LatencyHistogram {
+    std::atomic<unsigned long long> counts[LATENCY_BUCKETS] = {};
+    std::atomic<unsigned long long> samples{0}, sum{0}, max{0};
+};
+
+enum LatencyMetric {
+    LATENCY_CLICK_TO_PATH,    // Left click queued to its path first presented
+    LATENCY_TOGGLE_TO_REPLAN, // Obstacle toggle queued to the replanned path first presented
+    LATENCY_BATCH_BFS,        // One scenario-runner query
+    LATENCY_BATCH_ASTAR,
+    LATENCY_METRICS
+};
+const char* const LATENCY_METRIC_NAMES[] = {"click_to_path", "toggle_to_replan", "batch_query_bfs", "batch_query_astar"};
+const std::string LATENCY_FILE = "latency_histograms.txt";
+
+LatencyHistogram latencyHistograms[LATENCY_METRICS];
+Uint64 latencyPending[LATENCY_METRICS] = {}; // Input counter awaiting the next present; 0 when none
+
+// Per-frame rectangle batch: collected into a contiguous array and submitted with one
+// SDL_RenderFillRects call. clear() keeps the capacity, so steady-state frames allocate nothing.
+struct RectBatch {
+    SDL_Color color;
+    std::vector<SDL_Rect> rects;
+
+    RectBatch(SDL_Color c, size_t capacity) : color(c) { rects.reserve(capacity); }
+
+    void add(int x, int y, int w, int h) { rects.push_back({x, y, w, h}); }
+
+    void flush() {
+        if (!rects.empty()) {
+            SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+            SDL_RenderFillRects(renderer, rects.data(), (int)rects.size());
+        }
+        rects.clear();
+    }
+};
+
+RectBatch gridLineBatch({50, 50, 50, 255}, ROWS + COLS + 2);
+RectBatch obstacleBatch({200, 50, 50, 255}, ROWS * COLS);
+RectBatch pathBatch({255, 215, 0, 255}, ROWS * COLS); // Gold color
+RectBatch robotBatch({50, 200, 50, 255}, 64);
+RectBatch markerBatch({50, 50, 200, 255}, 64);
+RectBatch openBatch({60, 120, 180, 255}, 4096);   // Search frontier
+RectBatch closedBatch({45, 70, 100, 255}, 4096);  // Expanded cells
+
 // Function prototypes
-bool initSDL();
+bool parseOptions(int argc, char* argv[], Options& options);
+bool initSDL(bool headless);
 void destroySDL();
+
+// Frame capture
+bool startCapture(const std::string& path);
+void captureFrame();
+void stopCapture();
+void captureWriterLoop();
+
+// Camera and culling
+void clampCamera();
+void fitCameraToMap();
+CellRange visibleCells();
+SDL_Rect worldRect(double wx, double wy, double ww, double wh);
 void renderGrid();
 void renderObstacles();
+void renderStaticLayer();
+void renderObstaclesLod();
+void renderCellTextures();
+void syncCellTextures();
+void uploadCellTile(int tx, int ty);
+void destroyCellTextures();
+Uint32 cellColor(int x, int y);
+void patchStaticCell(const Point& cell);
 void renderRobot();
 void renderDestination();
 void renderPath(const std::vector<Point>& path);
 void renderText(const std::string& message, int x, int y, SDL_Color color);
+void renderLabel(TextLabel& label, const std::string& message, int x, int y, SDL_Color color);
 void renderInstructions();
 
+// Text caches
+bool buildGlyphAtlas();
+void destroyGlyphAtlas();
+void destroyLabel(TextLabel& label);
+
+bool isInsideGrid(int x, int y);
 bool isValidGridPosition(int x, int y);
 
+// Grid edits
+void setCell(int x, int y, int value);
+void markGridDirty();
+bool gridChangesSince(unsigned long long version, size_t& firstIndex);
+
+// Occupancy pyramid
+void resetPyramid();
+void buildPyramid(size_t budget);
+bool pyramidBuilding();
+void updatePyramid(int x, int y);
+void reducePyramidCell(int level, int x, int y);
+int pyramidCoverage(int level, int x, int y);
+
 // Pathfinding functions
+std::vector<Point> planPath(Point start, Point end);
 std::vector<Point> findPath(Point start, Point end);
 std::vector<Point> findPathA(Point start, Point end);
+template <typename Tracer> std::vector<Point> bfsSearch(Point start, Point end, Tracer& tracer);
+template <typename Tracer> std::vector<Point> aStarSearch(Point start, Point end, Tracer& tracer);
+template <typename Tracer> std::vector<Point> runPlanner(Point start, Point end, Tracer& tracer);
+
+// Search statistics
+void recordSearchStats(bool astar, const SearchStats& stats);
+int histogramBucket(unsigned long long value);
+unsigned long long histogramPercentile(const unsigned long long* buckets, unsigned long long count, double q);
+std::string searchStatsSummary();
+
+// Frame profiler
+void endProfileFrame();
+void profilePercentiles(int stage, double& p50, double& p99);
+void renderProfiler();
+
+// Span tracing
+TraceBuffer* localTraceBuffer();
+void startTrace();
+void stopTrace();
+bool flushTrace();
+
+// Latency histograms
+void recordLatency(LatencyMetric metric, Uint64 beginCounter);
+void recordLatencyNs(LatencyHistogram& h, unsigned long long ns);
+int latencyBucket(unsigned long long ns);
+unsigned long long latencyBucketHighest(int bucket);
+void mergeLatency(LatencyHistogram& into, const LatencyHistogram& from);
+unsigned long long latencyPercentile(const LatencyHistogram& h, double q);
+bool dumpLatencyHistograms(const std::string& filename);
+
+// Traffic heatmap
+void resetTraffic(int rows, int cols);
+bool trafficMatchesGrid();
+void recordVisit(int x, int y);
+void recordWait(int x, int y);
+unsigned int trafficVisits(int x, int y);
+unsigned int trafficWaitFrames(int x, int y);
+unsigned int trafficHeat(int x, int y);
+TrafficShardOwner& localTrafficShard();
+void allocateTrafficShard(TrafficShard& shard);
+void recordTraffic(bool wait, int x, int y);
+Uint32 heatColor(unsigned int heat, unsigned int peak);
+int congestionPenalty(int x, int y);
+void renderHeatmap();
+unsigned int trafficWrites();
+void exportHeatmap(const std::string& filename);
+
+// Search visualization
+void drainSearchEvents(int budget);
+void renderSearchOverlay();
+void clearSearchOverlay();
+
+// Frame pacing
+void waitUntil(Uint64 deadline);
+
+// Layout file I/O. Binary (run-length encoded) is the default; files ending in .txt use the text
+// format and files ending in .grid store one byte per cell so they can be memory-mapped instead of read.
+const std::string LAYOUT_FILE = "warehouse_layout.bin";
+const std::string LAYOUT_TEXT_FILE = "warehouse_layout.txt";
+
+struct LayoutHeader {
+    int version, encoding, layers;
+    Uint32 rows, cols;
+};
+
+void saveLayoutAsync(const std::string& filename);
+void layoutSaverLoop();
+void stopLayoutSaver();
+bool saveStatusVisible();
+void renderSaveStatus();
+void encodeLayout(const Grid& g, const std::string& filename, std::vector<unsigned char>& out);
+bool writeFileAtomic(const std::string& filename, const std::vector<unsigned char>& data);
+
+// Layout hot reload: a watcher thread reloads the file when it changes and diffs it against a
+// snapshot of the grid the event loop is showing, so the event loop only applies the changed cells
+// through setCell
+struct CellEdit {
+    Point cell;
+    unsigned char value;
+};
+
+struct LayoutReload {
+    Grid grid{0, 0};                 // Whole new layout, used when the size changed
+    bool resized = false;
+    std::vector<CellEdit> edits;     // Otherwise just the cells that differ from the current grid
+    bool costsChanged = false;
+};
+
+struct LayoutWatcher {
+    std::string path;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+#ifdef __linux__
+    int notifyFd = -1;
+#else
+    time_t lastTime = 0;
+    long long lastSize = -1;
+#endif
+    std::mutex mutex;
+    std::condition_variable snapshotTaken;
+    bool snapshotRequested = false;  // Watcher wants a copy of the current grid to diff against
+    Grid snapshot{0, 0};
+    bool ready = false;
+    LayoutReload reload;
+};
+
+LayoutWatcher layoutWatcher;
+const int WATCH_POLL_MS = 250;      // Stop-flag check interval, and stat() interval without inotify
+const int WATCH_SETTLE_MS = 50;     // Let the writer finish before reading
+
+bool startLayoutWatcher(const std::string& path);
+void stopLayoutWatcher();
+void layoutWatcherLoop();
+bool waitForLayoutChange();
+void reloadWatchedLayout();
+void serveLayoutSnapshot();
+bool applyLayoutReload(const std::vector<Point>& path, size_t from, bool& replan);
+
+// Input recording and replay. The log stores user input stamped with the simulation tick it was
+// handled on, plus every layout the session loaded, so a replay needs no files but the log:
+//   "WHIN" | u16 version | records
+// Each record is varint tick delta | u8 type | fields as zigzag varints. A replay steps exactly one
+// tick per frame and delivers each record at the start of the frame for its tick, so the
+// simulation sees the same input at the same ticks as the recorded session.
+enum InputType : unsigned char {
+    INPUT_MOUSE_DOWN = 1,  // button, x, y
+    INPUT_WHEEL,           // y, mouse x, mouse y
+    INPUT_PAN,             // x rel, y rel, button state
+    INPUT_KEY,             // sym, mod
+    INPUT_QUIT,
+    INPUT_LAYOUT,          // replan flag, length, encoded layout
+    INPUT_GOAL,            // x, y
+};
+const char INPUT_LOG_MAGIC[4] = {'W', 'H', 'I', 'N'};
+const int INPUT_LOG_VERSION = 1;
+const Sint32 REPLAY_LAYOUT = 1;    // SDL_USEREVENT codes for replayed non-SDL input
+const Sint32 REPLAY_GOAL = 2;
+
+struct InputRecorder {
+    bool active = false;
+    std::ofstream stream;
+    unsigned long long lastTick = 0;
+};
+
+struct ReplayedInput {
+    unsigned long long tick;
+    SDL_Event event;
+    Grid layout{0, 0};
+    bool replan = false;
+    Point goal;
+    Point cursor;                    // Where a wheel event zooms
+};
+
+struct InputReplay {
+    bool active = false;
+    bool finished = false;           // Every record delivered
+    std::deque<ReplayedInput> inputs;
+    Grid layout{0, 0};               // Payload of the REPLAY_LAYOUT event being handled
+    bool replan = false;
+    Point goal;
+};
+
+InputRecorder inputRecorder;
+InputReplay inputReplay;
+Point wheelCursor;                   // Cursor for the wheel event just polled; wheel.mouseX needs SDL 2.26
+Uint64 inputQueuedAt = 0;            // Performance counter when the input just polled was queued
+
+bool startRecording(const std::string& filename);
+void stopRecording();
+bool startReplay(const std::string& filename);
+bool pollInput(SDL_Event& e);
+bool isRecordedInput(const SDL_Event& e);
+bool changesFrame(const SDL_Event& e);
+void recordInput(const SDL_Event& e);
+void recordLayout(bool replan);
+void recordGoal(Point goal);
+void writeInputRecord(InputType type, const std::vector<int>& fields, const std::vector<unsigned char>& payload);
+void putZigzag(std::vector<unsigned char>& out, int value);
+bool getZigzag(const unsigned char*& p, const unsigned char* end, int& value);
+
+// Path export: every planned path, appended to a binary stream for controllers and analytics.
+//   "WHPT" | u16 version | records
+// Each record is a varint payload length, then u8 flags (PATH_FLAG_*) | zigzag start x, y |
+// zigzag goal x, y | varint move count | moves packed four per byte, low bits first, as 2-bit
+// directions (0 up, 1 right, 2 down, 3 left). Records go through an in-memory buffer that is
+// written out in large blocks, so a query costs a few bytes of encoding, not a syscall.
+struct PathExporter {
+    FILE* file = nullptr;
+    std::vector<unsigned char> buffer;
+    std::vector<unsigned char> record;  // Scratch, reused between queries
+    unsigned long long paths = 0;
+};
+
+PathExporter pathExporter;
+const char PATH_LOG_MAGIC[4] = {'W', 'H', 'P', 'T'};
+const int PATH_LOG_VERSION = 1;
+const unsigned char PATH_FLAG_ASTAR = 1;
+const unsigned char PATH_FLAG_FOUND = 2;
+const size_t PATH_EXPORT_BUFFER = 1 << 20;
 
-// Layout file I/O
-void saveLayout(const std::string& filename);
-void loadLayout(const std::string& filename);
+bool startPathExport(const std::string& filename);
+void stopPathExport();
+void exportPath(Point start, Point goal, const std::vector<Point>& path);
+void flushPathExport();
 
-int main() {
-    if (!initSDL()) return 1;
+// Planner benchmarks (the "bench" make target builds with WAREHOUSE_BENCH, whose main runs them).
+// Seeded map generators and query sets make runs reproducible; results are printed as JSON.
+enum BenchMap { BENCH_RANDOM, BENCH_MAZE, BENCH_RACKS, BENCH_ROOMS };
+const char* const BENCH_MAP_NAMES[] = {"random", "maze", "rack_aisle", "rooms"};
+
+struct BenchEngine {
+    const char* name;
+    std::vector<Point> (*plan)(Point start, Point end);
+    std::vector<Point> (*count)(Point start, Point end, SearchStatsTracer& tracer);
+};
+
+struct BenchResult {
+    double nsPerQuery = 0, expansionsPerQuery = 0, reopenedPerQuery = 0, pathLength = 0;
+    int found = 0;
+    size_t peakHeapBytes = 0, queuePeak = 0;
+};
+
+int runBenchmarks(int argc, char* argv[]);
+void generateBenchMap(BenchMap type, int size, unsigned seed);
+std::vector<std::pair<Point, Point>> generateBenchQueries(int count, unsigned seed);
+BenchResult runBenchEngine(const BenchEngine& engine, const std::vector<std::pair<Point, Point>>& queries);
+long long peakResidentKb();
+
+// Edit journal
+std::string journalPath();
+void loadJournaledLayout();
+bool applyJournaledLoad();
+FILE* openJournal(Grid& base, size_t& records);
+void detachJournal();
+void journalEdit(int x, int y, int value);
+void startJournal(bool baseWritten, Uint32 baseCrc);
+bool setJournalNextCrc(Uint32 crc);
+bool trimJournal(size_t records, Uint32 baseCrc);
+bool readBaseCrc(Uint32& crc);
+bool loadLayout(const std::string& filename);
+bool convertLayout(const std::string& from, const std::string& to);
+bool readLayoutFile(const std::string& filename, Grid& out);
+bool parseLayoutBinary(const std::vector<unsigned char>& data, Grid& out);
+bool parseLayoutHeader(const unsigned char* p, size_t size, LayoutHeader& header);
+size_t layoutFileSize(const LayoutHeader& header);
+void encodeRuns(const unsigned char* row, int cols, std::vector<unsigned char>& out);
+void encodeCostRuns(const unsigned char* row, int cols, std::vector<unsigned char>& out);
+bool decodeRuns(const unsigned char*& p, const unsigned char* end, unsigned char* cells, size_t count);
+bool decodeCostRuns(const unsigned char*& p, const unsigned char* end, unsigned char* costs, size_t count);
+void putVarint(std::vector<unsigned char>& out, Uint32 value);
+bool getVarint(const unsigned char*& p, const unsigned char* end, Uint32& value);
+bool mapLayoutFile(const std::string& filename, Grid& out);
+std::shared_ptr<MappedFile> mapFile(const std::string& filename);
+bool parseLayoutText(std::vector<unsigned char>& data, Grid& out);
+void applyLayout(Grid& loaded);
+Uint32 crc32(const unsigned char* data, size_t size);
+void putLE(std::vector<unsigned char>& out, Uint32 value, int bytes);
+Uint32 getLE(const unsigned char* in, int bytes);
+bool isTextLayoutFile(const std::string& filename);
+bool isMappableLayoutFile(const std::string& filename);
+bool parseMovingAiMap(const std::vector<unsigned char>& data, Grid& out);
+
+// Image import (BMP or binary PGM): each cellSize x cellSize block of pixels becomes one cell.
+// Blocks darker than the threshold are obstacles; with grayCosts, lighter blocks get one step of
+// extra cost per IMAGE_GRAY_PER_COST gray levels below white.
+struct ImageImport {
+    int cellSize = 1;
+    int threshold = 128;
+    bool grayCosts = false;
+};
+ImageImport imageImport;
+const int IMAGE_GRAY_PER_COST = 32;
+
+// Pixel access for the formats we import without converting the whole image first
+struct ImageView {
+    const unsigned char* pixels;
+    int width, height, pitch, bytesPerPixel;
+    const unsigned char* grayLut;    // 8-bit images: palette index or gray value to gray, or null
+    int rShift, gShift, bShift;      // 24/32-bit images
+
+    int gray(int x, int y) const {
+        const unsigned char* p = pixels + (size_t)y * pitch + (size_t)x * bytesPerPixel;
+        if (bytesPerPixel == 1) return grayLut ? grayLut[*p] : *p;
+        Uint32 v = p[0] | (p[1] << 8) | ((Uint32)p[2] << 16) | (bytesPerPixel == 4 ? (Uint32)p[3] << 24 : 0);
+        return (((v >> rShift) & 0xff) * 77 + ((v >> gShift) & 0xff) * 150 + ((v >> bShift) & 0xff) * 29) >> 8;
+    }
+};
+bool parseLayoutImage(const std::vector<unsigned char>& data, Grid& out);
+bool parsePgmHeader(const std::vector<unsigned char>& data, int& width, int& height, int& maxValue, size_t& offset);
+void thresholdImage(const ImageView& image, Grid& out);
+void thresholdImageRows(const ImageView& image, int y0, int y1, Grid& out);
+
+// MovingAI benchmark runner (https://movingai.com/benchmarks/formats.html)
+struct ScenarioBucket {
+    int scenarios = 0, failures = 0;
+    double seconds[2] = {0, 0};     // BFS, A*
+    double expanded[2] = {0, 0};
+    double lengthRatio = 0;         // Our path length over the reference optimum
+};
+bool runScenarios(const std::string& filename);
+bool checkScenarioPath(const std::vector<Point>& path, Point start, Point goal);
+
+int main(int argc, char* argv[]) {
+#ifdef WAREHOUSE_BENCH
+    return runBenchmarks(argc, argv);
+#endif
+    traceThreadName = "main";
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 1;
+    if (!options.scenarioPath.empty()) return runScenarios(options.scenarioPath) ? 0 : 1;
+    if (!options.convertPath.empty()) return convertLayout(options.layoutPath, options.convertPath) ? 0 : 1;
+    if (!initSDL(options.headless)) return 1;
+    if (!options.capturePath.empty() && !startCapture(options.capturePath)) {
+        destroySDL();
+        return 1;
+    }
 
     SDL_Event e;
     bool quit = false;
     std::vector<Point> path;
     size_t currentPathIndex = 0;
+    int framesRendered = 0;
+
+    if ((!options.recordPath.empty() && !startRecording(options.recordPath)) ||
+        (!options.replayPath.empty() && !startReplay(options.replayPath)) ||
+        (!options.pathExportPath.empty() && !startPathExport(options.pathExportPath))) {
+        stopCapture();
+        destroySDL();
+        return 1;
+    }
+
+    if (!options.tracePath.empty()) {
+        spanTrace.path = options.tracePath;
+        startTrace();
+    }
+
+    // A replay brings its own layouts and goal; loading files here would only be overwritten
+    if (!inputReplay.active) {
+        if (options.watchLayout) startLayoutWatcher(options.layoutPath.empty() ? LAYOUT_TEXT_FILE : options.layoutPath);
+        if (!options.layoutPath.empty()) {
+            loadLayout(options.layoutPath);
+        } else {
+            // Edits journaled since the last save survive a crash: restore them onto the saved layout
+            std::ifstream journal(journalPath(), std::ios::binary);
+            if (journal) loadLayout(LAYOUT_FILE);
+        }
+        if (options.hasGoal && isValidGridPosition(options.goal.x, options.goal.y)) {
+            destination = options.goal;
+            hasDestination = true;
+            path = planPath(robot.gridPos, destination);
+            recordGoal(destination);
+        }
+    }
+    const bool fixedStep = options.headless || inputReplay.active;
+
+    const Uint64 frequency = SDL_GetPerformanceFrequency();
+    const Uint64 framePeriod = (Uint64)(TARGET_FRAME_SECONDS * frequency);
+    Uint64 lastTime = SDL_GetPerformanceCounter();
+    Uint64 nextFrame = lastTime + framePeriod;
+    double simAccumulator = 0;
+    bool redraw = true;
 
     while (!quit) {
-        // Event handling
-        while (SDL_PollEvent(&e)) {
+        // Nothing moving and nothing to redraw: sleep in the event queue instead of spinning
+        bool blocked = hasDestination && path.empty();
+        bool animating = (hasDestination && currentPathIndex < path.size()) ||
+                         (showSearch && !searchEvents.empty()) ||
+                         (showHeatmap && trafficWrites() != heatmapOverlay.mergedWrites) ||
+                         saveStatusVisible() || pyramidBuilding();
+        if (!animating && !redraw && !options.headless && !inputReplay.active) {
+            profileStage(PROFILE_IDLE);
+            if (blocked) {
+                // Only wait time is accruing: wake for the next simulation tick, but draw nothing
+                int timeoutMs = (int)std::ceil((SIM_TICK_SECONDS - simAccumulator) * 1000);
+                SDL_WaitEventTimeout(nullptr, std::max(1, timeoutMs));
+            } else {
+                SDL_WaitEvent(nullptr);
+                lastTime = SDL_GetPerformanceCounter();
+            }
+            nextFrame = SDL_GetPerformanceCounter();
+        }
+
+        // Event handling: live input, or the replayed input due this tick
+        profileStage(PROFILE_EVENTS);
+        while (pollInput(e)) {
+            if (changesFrame(e)) redraw = true;
             if (e.type == SDL_QUIT) {
                 quit = true;
             }
+            // Replayed layout loads and startup goal
+            else if (e.type == SDL_USEREVENT && e.user.code == REPLAY_LAYOUT) {
+                applyLayout(inputReplay.layout);
+                if (!hasDestination) {
+                    path.clear();
+                } else if (inputReplay.replan) {
+                    path = planPath(robot.gridPos, destination);
+                    currentPathIndex = 0;
+                }
+            }
+            else if (e.type == SDL_USEREVENT && e.user.code == REPLAY_GOAL) {
+                destination = inputReplay.goal;
+                hasDestination = true;
+                path = planPath(robot.gridPos, destination);
+                currentPathIndex = 0;
+            }
+            // Render target contents are lost on device reset; redraw from scratch
+            else if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET) {
+                staticLayer.version = VIEW_INVALID;
+                cellLayer.version = VIEW_INVALID;
+            }
+            // Camera: wheel zooms around the cursor, middle drag pans
+            else if (e.type == SDL_MOUSEWHEEL) {
+                camera.zoomAt(wheelCursor.x, wheelCursor.y, std::pow(1.25, e.wheel.y));
+                clampCamera();
+            }
+            else if (e.type == SDL_MOUSEMOTION && (e.motion.state & SDL_BUTTON_MMASK)) {
+                camera.pan(e.motion.xrel, e.motion.yrel);
+                clampCamera();
+            }
             // Mouse events
             else if (e.type == SDL_MOUSEBUTTONDOWN) {
-                int gridX = e.button.x / GRID_SIZE;
-                int gridY = e.button.y / GRID_SIZE;
+                int gridX = camera.toCellX(e.button.x);
+                int gridY = camera.toCellY(e.button.y);
 
                 // Left click: set destination and calculate path
                 if (e.button.button == SDL_BUTTON_LEFT) {
                     if (isValidGridPosition(gridX, gridY)) {
                         destination = {gridX, gridY};
                         hasDestination = true;
-                        if (useAStar)
-                            path = findPathA(robot.gridPos, destination);
-                        else
-                            path = findPath(robot.gridPos, destination);
+                        path = planPath(robot.gridPos, destination);
                         currentPathIndex = 0;
+                        latencyPending[LATENCY_CLICK_TO_PATH] = inputQueuedAt;
                     }
                 }
                 // Right click: toggle obstacle & re-plan if needed
-                else if (e.button.button == SDL_BUTTON_RIGHT) {
-                    warehouseGrid[gridY][gridX] = 1 - warehouseGrid[gridY][gridX];
+                else if (e.button.button == SDL_BUTTON_RIGHT && isInsideGrid(gridX, gridY)) {
+                    setCell(gridX, gridY, 1 - warehouseGrid[gridY][gridX]);
+                    journalEdit(gridX, gridY, warehouseGrid[gridY][gridX]);
                     // If destination is active, re-calc path in case it’s affected
                     if (hasDestination) {
-                        if (useAStar)
-                            path = findPathA(robot.gridPos, destination);
-                        else
-                            path = findPath(robot.gridPos, destination);
+                        path = planPath(robot.gridPos, destination);
                         currentPathIndex = 0;
+                        latencyPending[LATENCY_TOGGLE_TO_REPLAN] = inputQueuedAt;
                     }
                 }
             }
@@ -148,61 +1245,258 @@ int main() {
                     useAStar = !useAStar;
                     // Re-calc path if destination exists
                     if (hasDestination) {
-                        if (useAStar)
-                            path = findPathA(robot.gridPos, destination);
-                        else
-                            path = findPath(robot.gridPos, destination);
+                        path = planPath(robot.gridPos, destination);
                         currentPathIndex = 0;
                     }
                 }
-                // Save layout to file
-                else if (e.key.keysym.sym == SDLK_s) {
-                    saveLayout("warehouse_layout.txt");
+                // Pan with the arrow keys, fit the whole map with F
+                else if (e.key.keysym.sym == SDLK_LEFT || e.key.keysym.sym == SDLK_RIGHT ||
+                         e.key.keysym.sym == SDLK_UP || e.key.keysym.sym == SDLK_DOWN) {
+                    double step = SCREEN_WIDTH / 8.0;
+                    camera.pan(e.key.keysym.sym == SDLK_LEFT ? step : e.key.keysym.sym == SDLK_RIGHT ? -step : 0,
+                               e.key.keysym.sym == SDLK_UP ? step : e.key.keysym.sym == SDLK_DOWN ? -step : 0);
+                    clampCamera();
+                }
+                else if (e.key.keysym.sym == SDLK_f) {
+                    fitCameraToMap();
+                }
+                // Switch between rect drawing and streaming cell textures
+                else if (e.key.keysym.sym == SDLK_v) {
+                    useCellTextures = !useCellTextures;
+                }
+                // Collect per-search statistics for the HUD
+                else if (e.key.keysym.sym == SDLK_i) {
+                    collectSearchStats = !collectSearchStats;
+                }
+                // Frame profiler overlay
+                else if (e.key.keysym.sym == SDLK_p) {
+                    frameProfiler.visible = !frameProfiler.visible;
+                }
+                // Span trace: stopping writes what was recorded
+                else if (e.key.keysym.sym == SDLK_j) {
+                    if (spanTrace.recording)
+                        stopTrace();
+                    else
+                        startTrace();
+                }
+                // Toggle the search expansion animation and change its speed
+                else if (e.key.keysym.sym == SDLK_e) {
+                    showSearch = !showSearch;
+                    if (!showSearch) clearSearchOverlay();
+                }
+                else if (e.key.keysym.sym == SDLK_LEFTBRACKET) {
+                    searchEventsPerFrame = std::max(1, searchEventsPerFrame / 2);
+                }
+                else if (e.key.keysym.sym == SDLK_RIGHTBRACKET) {
+                    searchEventsPerFrame = std::min(1 << 20, searchEventsPerFrame * 2);
+                }
+                // Traffic heatmap overlay, export and congestion-aware routing
+                else if (e.key.keysym.sym == SDLK_h) {
+                    showHeatmap = !showHeatmap;
+                    heatmapOverlay.framesUntilRefresh = 0;
+                }
+                else if (e.key.keysym.sym == SDLK_x) {
+                    exportHeatmap("traffic_heatmap.csv");
+                }
+                else if (e.key.keysym.sym == SDLK_d) {
+                    dumpLatencyHistograms(LATENCY_FILE);
                 }
-                // Load layout from file
-                else if (e.key.keysym.sym == SDLK_l) {
-                    loadLayout("warehouse_layout.txt");
-                    // Recalculate path if necessary
+                else if (e.key.keysym.sym == SDLK_c) {
+                    useCongestionCost = !useCongestionCost;
                     if (hasDestination) {
-                        if (useAStar)
-                            path = findPathA(robot.gridPos, destination);
-                        else
-                            path = findPath(robot.gridPos, destination);
+                        path = planPath(robot.gridPos, destination);
                         currentPathIndex = 0;
                     }
                 }
+                // Save layout to file (Shift+S exports the text format)
+                else if (e.key.keysym.sym == SDLK_s) {
+                    saveLayoutAsync((e.key.keysym.mod & KMOD_SHIFT) ? LAYOUT_TEXT_FILE : LAYOUT_FILE);
+                }
+                // Load layout from file, falling back to the text export if there is no binary save
+                // A replay delivers the loaded layout and its replan as a separate record
+                else if (e.key.keysym.sym == SDLK_l && !inputReplay.active) {
+                    std::ifstream probe(LAYOUT_FILE, std::ios::binary);
+                    // Recalculate path if necessary. A failed load changes nothing and records nothing;
+                    // the binary save lands later and replans then.
+                    if (loadLayout(probe ? LAYOUT_FILE : LAYOUT_TEXT_FILE)) {
+                        if (hasDestination) {
+                            path = planPath(robot.gridPos, destination);
+                            currentPathIndex = 0;
+                        } else {
+                            path.clear(); // Destination fell outside a smaller map
+                        }
+                    }
+                }
+            }
+        }
+
+        // Apply a hot-reloaded layout; replan only if the change touches the rest of the route
+        bool replan = false;
+        if (applyLayoutReload(path, currentPathIndex, replan)) {
+            recordLayout(replan);
+            redraw = true;
+            if (replan && hasDestination) {
+                path = planPath(robot.gridPos, destination);
+                currentPathIndex = 0;
+            } else if (!hasDestination) {
+                path.clear();
+            }
+        }
+        serveLayoutSnapshot();
+
+        // A load of the journaled layout the writer has finished
+        if (applyJournaledLoad()) {
+            redraw = true;
+            if (hasDestination) {
+                path = planPath(robot.gridPos, destination);
+                currentPathIndex = 0;
+            } else {
+                path.clear();
             }
         }
 
-        // Robot movement along path
-        if (hasDestination && currentPathIndex < path.size()) {
-            robot.moveToward(path[currentPathIndex], 2.0);
-            if (robot.gridPos == path[currentPathIndex]) {
-                ++currentPathIndex;
+        // Advance the simulation in fixed ticks so robot speed doesn't depend on the frame rate
+        // Headless runs are unthrottled and deterministic: exactly one tick per frame
+        // Replays do the same so input lands on the tick it was recorded on
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (fixedStep)
+            simAccumulator += SIM_TICK_SECONDS;
+        else
+            simAccumulator = std::min(simAccumulator + (double)(now - lastTime) / frequency, MAX_CATCHUP_SECONDS);
+        lastTime = now;
+        profileStage(PROFILE_MOVE);
+        while (simAccumulator >= SIM_TICK_SECONDS) {
+            simAccumulator -= SIM_TICK_SECONDS;
+            ++simTick;
+
+            // Robot movement along path
+            if (hasDestination && currentPathIndex < path.size()) {
+                robot.moveToward(path[currentPathIndex], 2.0);
+                if (robot.gridPos == path[currentPathIndex]) {
+                    recordVisit(robot.gridPos.x, robot.gridPos.y);
+                    ++currentPathIndex;
+                }
+            } else if (hasDestination && path.empty()) {
+                recordWait(robot.gridPos.x, robot.gridPos.y); // Blocked: no route to the destination
             }
         }
 
+        // Blocked-robot wait counts only show up on the heatmap, so they don't need a frame otherwise
+        bool heatChanged = showHeatmap && trafficWrites() != heatmapOverlay.mergedWrites;
+        if (!animating && !redraw && !heatChanged && !options.headless) continue;
+        redraw = false;
+
         // Rendering
+        profileStage(PROFILE_GRID);
         SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
         SDL_RenderClear(renderer);
 
-        renderGrid();
-        renderObstacles();
+        if (useCellTextures)
+            renderCellTextures(); // One texel per cell, dirty rows uploaded
+        else
+            renderStaticLayer();  // Cached grid lines and obstacles
+        profileStage(PROFILE_OVERLAYS);
+        if (showSearch) {
+            drainSearchEvents(searchEventsPerFrame);
+            renderSearchOverlay();
+        }
+        if (showHeatmap) renderHeatmap();
         renderPath(path);       // Draw the computed path
         renderRobot();
         renderDestination();
         renderInstructions();   // Draw instructions & current algorithm
+        renderSaveStatus();
+        if (frameProfiler.visible) renderProfiler();
 
+        profileStage(PROFILE_PRESENT);
+        if (frameCapture.active) captureFrame();
         SDL_RenderPresent(renderer);
-        SDL_Delay(16);
-    }
+        // Input latency runs until the user can see the result; a later click in the same frame
+        // supersedes an earlier one whose path was never shown
+        for (int m = LATENCY_CLICK_TO_PATH; m <= LATENCY_TOGGLE_TO_REPLAN; ++m) {
+            if (latencyPending[m]) recordLatency((LatencyMetric)m, latencyPending[m]);
+            latencyPending[m] = 0;
+        }
+        endProfileFrame();
+        if (options.frames > 0 && ++framesRendered >= options.frames) quit = true;
+        if (inputReplay.finished && !(hasDestination && currentPathIndex < path.size())) quit = true;
 
+        // With vsync the present above already waited for the display; otherwise sleep to the deadline
+        if (!vsyncActive && !options.headless) {
+            Uint64 after = SDL_GetPerformanceCounter();
+            nextFrame = after > nextFrame + framePeriod ? after + framePeriod : nextFrame + framePeriod;
+            waitUntil(nextFrame);
+        }
+    }
+
+    stopCapture();
+    stopRecording();
+    stopPathExport();
+    stopLayoutWatcher();
+    stopLayoutSaver(); // Finish queued saves before exiting
+    detachJournal();
+    if (spanTrace.recording) stopTrace();
+    if (latencyHistograms[LATENCY_CLICK_TO_PATH].samples || latencyHistograms[LATENCY_TOGGLE_TO_REPLAN].samples)
+        dumpLatencyHistograms(LATENCY_FILE);
     destroySDL();
     return 0;
 }
 
-bool initSDL() {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frames" && hasValue) {
+            options.frames = std::atoi(argv[++i]);
+        } else if (arg == "--capture" && hasValue) {
+            options.capturePath = argv[++i];
+        } else if (arg == "--layout" && hasValue) {
+            options.layoutPath = argv[++i];
+        } else if (arg == "--goal" && hasValue && std::sscanf(argv[i + 1], "%d,%d", &options.goal.x, &options.goal.y) == 2) {
+            options.hasGoal = true;
+            ++i;
+        } else if (arg == "--scen" && hasValue) {
+            options.scenarioPath = argv[++i];
+        } else if (arg == "--cell-size" && hasValue) {
+            imageImport.cellSize = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threshold" && hasValue) {
+            imageImport.threshold = std::atoi(argv[++i]);
+        } else if (arg == "--gray-costs") {
+            imageImport.grayCosts = true;
+        } else if (arg == "--watch") {
+            options.watchLayout = true;
+        } else if (arg == "--record" && hasValue) {
+            options.recordPath = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            options.replayPath = argv[++i];
+        } else if (arg == "--export-paths" && hasValue) {
+            options.pathExportPath = argv[++i];
+        } else if (arg == "--trace" && hasValue) {
+            options.tracePath = argv[++i];
+        } else if (arg == "--convert" && hasValue) {
+            options.convertPath = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--headless] [--frames N] [--capture PREFIX|FILE.raw]"
+                      << " [--layout FILE] [--goal X,Y] [--scen FILE.scen]"
+                      << " [--cell-size PIXELS] [--threshold GRAY] [--gray-costs] [--watch]"
+                      << " [--record FILE | --replay FILE] [--export-paths FILE] [--trace FILE.json]"
+                      << " [--layout FILE --convert OUT.bin|OUT.txt|OUT.grid]" << std::endl;
+            return false;
+        }
+    }
+    if (!options.convertPath.empty() && options.layoutPath.empty()) {
+        std::cerr << "--convert needs a --layout to read" << std::endl;
+        return false;
+    }
+    // A headless run has no window to close, so it needs an end (a replay ends with its log)
+    if (options.headless && options.frames <= 0 && options.replayPath.empty()) options.frames = 600;
+    return true;
+}
+
+bool initSDL(bool headless) {
+    if (SDL_Init(headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO) < 0) {
         std::cerr << "SDL could not initialize! SDL_Error: " 
                   << SDL_GetError() << std::endl;
         return false;
@@ -214,20 +1508,33 @@ bool initSDL() {
         return false;
     }
     
-    window = SDL_CreateWindow("Automated Warehouse Robot", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 
-                              SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-    if (!window) {
-        std::cerr << "Window could not be created! SDL_Error: " 
-                  << SDL_GetError() << std::endl;
-        return false;
+    if (headless) {
+        // Offscreen: the software renderer draws into a plain surface, no display needed
+        offscreenSurface = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
+                                                          SDL_PIXELFORMAT_ARGB8888);
+        if (!offscreenSurface) {
+            std::cerr << "Offscreen surface could not be created! SDL_Error: "
+                      << SDL_GetError() << std::endl;
+            return false;
+        }
+        renderer = SDL_CreateSoftwareRenderer(offscreenSurface);
+    } else {
+        window = SDL_CreateWindow("Automated Warehouse Robot", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 
+                                  SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+        if (!window) {
+            std::cerr << "Window could not be created! SDL_Error: " 
+                      << SDL_GetError() << std::endl;
+            return false;
+        }
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     }
-
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     if (!renderer) {
         std::cerr << "Renderer could not be created! SDL_Error: " 
                   << SDL_GetError() << std::endl;
         return false;
     }
+    SDL_RendererInfo info;
+    vsyncActive = SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
     
     // Load a font (ensure the font file is in your working directory)
     font = TTF_OpenFont("ARIAL.TTF", 16);
@@ -236,99 +1543,759 @@ bool initSDL() {
                   << TTF_GetError() << std::endl;
         return false;
     }
+
+    if (!buildGlyphAtlas()) {
+        std::cerr << "Failed to build glyph atlas! SDL_Error: "
+                  << SDL_GetError() << std::endl;
+        return false;
+    }
     
     return true;
 }
 
 void destroySDL() {
+    for (auto& label : instructionLabels) {
+        destroyLabel(label);
+    }
+    destroyGlyphAtlas();
+    if (staticLayer.texture) SDL_DestroyTexture(staticLayer.texture);
+    staticLayer.texture = nullptr;
+    if (lodTexture) SDL_DestroyTexture(lodTexture);
+    lodTexture = nullptr;
+    destroyCellTextures();
+    if (heatmapOverlay.texture) SDL_DestroyTexture(heatmapOverlay.texture);
+    heatmapOverlay.texture = nullptr;
     TTF_CloseFont(font);
     font = nullptr;
     TTF_Quit();
     SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    if (window) SDL_DestroyWindow(window);
+    if (offscreenSurface) SDL_FreeSurface(offscreenSurface);
+    offscreenSurface = nullptr;
     SDL_Quit();
 }
 
+bool startCapture(const std::string& path) {
+    FrameCapture& cap = frameCapture;
+    cap.path = path;
+    cap.raw = path.size() > 4 && path.compare(path.size() - 4, 4, ".raw") == 0;
+    if (cap.raw) {
+        cap.rawStream.open(path, std::ios::binary);
+        if (!cap.rawStream) {
+            std::cerr << "Error opening capture stream " << path << std::endl;
+            return false;
+        }
+    }
+    cap.stopping = false;
+    cap.active = true;
+    cap.writer = std::thread(captureWriterLoop);
+    return true;
+}
+
+void captureFrame() {
+    FrameCapture& cap = frameCapture;
+    const size_t frameBytes = (size_t)SCREEN_WIDTH * SCREEN_HEIGHT * 4;
+
+    // Take a pooled buffer; if the writer has all of them, wait for one rather than drop a frame
+    std::vector<Uint8> buffer;
+    {
+        std::unique_lock<std::mutex> lock(cap.mutex);
+        if (cap.freeBuffers.empty() && cap.buffersAllocated < CAPTURE_POOL_SIZE) {
+            ++cap.buffersAllocated;
+            lock.unlock();
+            buffer.resize(frameBytes);
+        } else {
+            cap.changed.wait(lock, [&] { return !cap.freeBuffers.empty(); });
+            buffer.swap(cap.freeBuffers.back());
+            cap.freeBuffers.pop_back();
+        }
+    }
+
+    if (offscreenSurface) {
+        SDL_RenderFlush(renderer);
+        for (int y = 0; y < SCREEN_HEIGHT; ++y) {
+            SDL_memcpy(buffer.data() + (size_t)y * SCREEN_WIDTH * 4,
+                       (Uint8*)offscreenSurface->pixels + (size_t)y * offscreenSurface->pitch, SCREEN_WIDTH * 4);
+        }
+    } else {
+        SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_ARGB8888, buffer.data(), SCREEN_WIDTH * 4);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cap.mutex);
+        cap.queue.push_back({cap.framesCaptured++, std::move(buffer)});
+    }
+    cap.changed.notify_all();
+}
+
+void captureWriterLoop() {
+    FrameCapture& cap = frameCapture;
+    traceThreadName = "capture writer";
+    for (;;) {
+        CapturedFrame frame;
+        {
+            std::unique_lock<std::mutex> lock(cap.mutex);
+            cap.changed.wait(lock, [&] { return cap.stopping || !cap.queue.empty(); });
+            if (cap.queue.empty()) return; // Stopping and fully drained
+            frame = std::move(cap.queue.front());
+            cap.queue.pop_front();
+        }
+
+        TraceScope trace("write frame");
+        if (cap.raw) {
+            cap.rawStream.write((const char*)frame.pixels.data(), (std::streamsize)frame.pixels.size());
+        } else {
+            char name[32];
+            std::snprintf(name, sizeof(name), "_%06llu.bmp", frame.index);
+            SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(frame.pixels.data(), SCREEN_WIDTH, SCREEN_HEIGHT,
+                                                                      32, SCREEN_WIDTH * 4, SDL_PIXELFORMAT_ARGB8888);
+            if (!surface || SDL_SaveBMP(surface, (cap.path + name).c_str()) != 0) {
+                std::cerr << "Error writing captured frame! SDL_Error: " << SDL_GetError() << std::endl;
+            }
+            if (surface) SDL_FreeSurface(surface);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(cap.mutex);
+            cap.freeBuffers.push_back(std::move(frame.pixels));
+        }
+        cap.changed.notify_all();
+    }
+}
+
+void stopCapture() {
+    FrameCapture& cap = frameCapture;
+    if (!cap.active) return;
+    {
+        std::lock_guard<std::mutex> lock(cap.mutex);
+        cap.stopping = true;
+    }
+    cap.changed.notify_all();
+    cap.writer.join();
+    if (cap.rawStream.is_open()) cap.rawStream.close();
+    cap.active = false;
+    std::cout << "Captured " << cap.framesCaptured << " frames to " << cap.path << std::endl;
+}
+
+void clampCamera() {
+    // Keep the centre of the view over the map so it can't be lost off-screen
+    double halfW = SCREEN_WIDTH / camera.zoom / 2;
+    double halfH = SCREEN_HEIGHT / camera.zoom / 2;
+    camera.x = std::max(-halfW, std::min(camera.x, (double)warehouseGrid.cols * GRID_SIZE - halfW));
+    camera.y = std::max(-halfH, std::min(camera.y, (double)warehouseGrid.rows * GRID_SIZE - halfH));
+}
+
+void fitCameraToMap() {
+    double fitX = (double)SCREEN_WIDTH / (warehouseGrid.cols * GRID_SIZE);
+    double fitY = (double)SCREEN_HEIGHT / (warehouseGrid.rows * GRID_SIZE);
+    camera.zoom = std::max(MIN_ZOOM, std::min(1.0, std::min(fitX, fitY)));
+    camera.x = 0;
+    camera.y = 0;
+}
+
+CellRange visibleCells() {
+    CellRange r;
+    r.x0 = std::max(0, camera.toCellX(0));
+    r.y0 = std::max(0, camera.toCellY(0));
+    r.x1 = std::min(warehouseGrid.cols, camera.toCellX(SCREEN_WIDTH - 1) + 1);
+    r.y1 = std::min(warehouseGrid.rows, camera.toCellY(SCREEN_HEIGHT - 1) + 1);
+    return r;
+}
+
+SDL_Rect worldRect(double wx, double wy, double ww, double wh) {
+    // Snap both edges so adjacent cells tile without gaps; never collapse below one pixel
+    int x0 = (int)std::floor(camera.toScreenX(wx));
+    int y0 = (int)std::floor(camera.toScreenY(wy));
+    int x1 = (int)std::floor(camera.toScreenX(wx + ww));
+    int y1 = (int)std::floor(camera.toScreenY(wy + wh));
+    return {x0, y0, std::max(1, x1 - x0), std::max(1, y1 - y0)};
+}
+
 void renderGrid() {
-    SDL_SetRenderDrawColor(renderer, 50, 50, 50, 255);
-    for (int i = 0; i <= ROWS; ++i) {
-        SDL_RenderDrawLine(renderer, 0, i * GRID_SIZE, SCREEN_WIDTH, i * GRID_SIZE);
+    ProfileScope scope(PROFILE_GRID);
+    if (camera.cellPixels() < MIN_GRID_LINE_SPACING) return;
+    CellRange r = visibleCells();
+    if (r.x0 >= r.x1 || r.y0 >= r.y1) return;
+
+    int left = (int)std::floor(camera.toScreenX(r.x0 * GRID_SIZE));
+    int top = (int)std::floor(camera.toScreenY(r.y0 * GRID_SIZE));
+    int right = (int)std::floor(camera.toScreenX(r.x1 * GRID_SIZE));
+    int bottom = (int)std::floor(camera.toScreenY(r.y1 * GRID_SIZE));
+    for (int i = r.y0; i <= r.y1; ++i) {
+        gridLineBatch.add(left, (int)std::floor(camera.toScreenY(i * GRID_SIZE)), right - left + 1, 1);
     }
-    for (int i = 0; i <= COLS; ++i) {
-        SDL_RenderDrawLine(renderer, i * GRID_SIZE, 0, i * GRID_SIZE, SCREEN_HEIGHT);
+    for (int i = r.x0; i <= r.x1; ++i) {
+        gridLineBatch.add((int)std::floor(camera.toScreenX(i * GRID_SIZE)), top, 1, bottom - top + 1);
     }
+    gridLineBatch.flush();
 }
 
 void renderObstacles() {
-    SDL_SetRenderDrawColor(renderer, 200, 50, 50, 255);
-    for (int i = 0; i < ROWS; ++i) {
-        for (int j = 0; j < COLS; ++j) {
-            if (warehouseGrid[i][j] == 1) {
-                SDL_Rect rect = {j * GRID_SIZE, i * GRID_SIZE, GRID_SIZE, GRID_SIZE};
-                SDL_RenderFillRect(renderer, &rect);
+    ProfileScope scope(PROFILE_OBSTACLES);
+    if (camera.cellPixels() < LOD_CELL_PIXELS) {
+        renderObstaclesLod();
+        return;
+    }
+
+    CellRange r = visibleCells();
+    for (int i = r.y0; i < r.y1; ++i) {
+        const unsigned char* row = warehouseGrid[i];
+        for (int j = r.x0; j < r.x1; ++j) {
+            if (row[j] == 1) {
+                obstacleBatch.rects.push_back(worldRect(j * GRID_SIZE, i * GRID_SIZE, GRID_SIZE, GRID_SIZE));
             }
         }
     }
+    obstacleBatch.flush();
 }
 
-void renderRobot() {
-    SDL_SetRenderDrawColor(renderer, 50, 200, 50, 255);
-    SDL_Rect rect = {(int)(robot.x - ROBOT_RADIUS), (int)(robot.y - ROBOT_RADIUS), ROBOT_RADIUS * 2, ROBOT_RADIUS * 2};
+void renderStaticLayer() {
+    if (!staticLayer.texture) {
+        staticLayer.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                                SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
+        if (!staticLayer.texture) {
+            // No render-target support: fall back to immediate drawing
+            renderGrid();
+            renderObstacles();
+            return;
+        }
+        staticLayer.version = VIEW_INVALID;
+    }
+
+    bool cameraMoved = staticLayer.cameraX != camera.x || staticLayer.cameraY != camera.y ||
+                       staticLayer.cameraZoom != camera.zoom;
+    if (staticLayer.version != gridVersion || cameraMoved) {
+        SDL_SetRenderTarget(renderer, staticLayer.texture);
+        size_t first = 0;
+        bool patchable = staticLayer.version != VIEW_INVALID && gridChangesSince(staticLayer.version, first) &&
+                         gridJournal.size() - first <= MAX_PATCHED_CELLS;
+        bool lod = camera.cellPixels() < LOD_CELL_PIXELS; // One texture upload, cheaper than patching
+        if (!patchable || cameraMoved || lod) {
+            SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
+            SDL_RenderClear(renderer);
+            renderGrid();
+            renderObstacles();
+        } else {
+            for (size_t i = first; i < gridJournal.size(); ++i) {
+                patchStaticCell(gridJournal[i].cell);
+            }
+        }
+        SDL_SetRenderTarget(renderer, nullptr);
+        staticLayer.version = lod && pyramidBuilding() ? VIEW_INVALID : gridVersion; // Redraw as rows arrive
+        staticLayer.cameraX = camera.x;
+        staticLayer.cameraY = camera.y;
+        staticLayer.cameraZoom = camera.zoom;
+    }
+
+    SDL_RenderCopy(renderer, staticLayer.texture, nullptr, nullptr);
+}
+
+void renderObstaclesLod() {
+    if (occupancyPyramid.levels.empty()) resetPyramid();
+    buildPyramid(PYRAMID_CELLS_PER_FRAME);
+    if (!lodTexture) {
+        // Each visible pyramid cell is at least one pixel, so a screen-sized texture always suffices
+        lodTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                       SCREEN_WIDTH + 2, SCREEN_HEIGHT + 2);
+        if (!lodTexture) return;
+        SDL_SetTextureScaleMode(lodTexture, SDL_ScaleModeNearest);
+    }
+
+    // Pick the finest level whose cells cover at least one screen pixel
+    int level = 0;
+    while (level + 1 < (int)occupancyPyramid.levels.size() && camera.cellPixels() * (1 << level) < 1.0) {
+        ++level;
+    }
+    const OccupancyPyramid::Level& lv = occupancyPyramid.levels[level];
+    int span = 1 << level;
+
+    CellRange r = visibleCells();
+    int lx0 = r.x0 / span, ly0 = r.y0 / span;
+    int lx1 = std::min(lv.cols, (r.x1 + span - 1) / span);
+    int ly1 = std::min(lv.rows, (r.y1 + span - 1) / span);
+    int w = std::min(lx1 - lx0, SCREEN_WIDTH + 2), h = std::min(ly1 - ly0, SCREEN_HEIGHT + 2);
+    if (w <= 0 || h <= 0) return;
+
+    // Background-to-obstacle colour ramp indexed by coverage
+    static Uint32 palette[256];
+    static bool paletteReady = false;
+    if (!paletteReady) {
+        for (int c = 0; c < 256; ++c) {
+            Uint32 red = 20 + (200 - 20) * c / 255;
+            Uint32 green = 20 + (50 - 20) * c / 255;
+            Uint32 blue = 20 + (50 - 20) * c / 255;
+            palette[c] = 0xFF000000u | (red << 16) | (green << 8) | blue;
+        }
+        paletteReady = true;
+    }
+
+    SDL_Rect src = {0, 0, w, h};
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(lodTexture, &src, &pixels, &pitch) != 0) return;
+    for (int y = 0; y < h; ++y) {
+        Uint32* out = (Uint32*)((Uint8*)pixels + (size_t)y * pitch);
+        bool built = ly0 + y < lv.rowsBuilt;
+        for (int x = 0; x < w; ++x) {
+            out[x] = palette[built ? pyramidCoverage(level, lx0 + x, ly0 + y) : 0];
+        }
+    }
+    SDL_UnlockTexture(lodTexture);
+
+    // Clip the last row/column of pyramid cells to the map edge
+    double worldW = std::min((double)(lx0 + w) * span, (double)warehouseGrid.cols) - (double)lx0 * span;
+    double worldH = std::min((double)(ly0 + h) * span, (double)warehouseGrid.rows) - (double)ly0 * span;
+    SDL_Rect dst = worldRect((double)lx0 * span * GRID_SIZE, (double)ly0 * span * GRID_SIZE,
+                             worldW * GRID_SIZE, worldH * GRID_SIZE);
+    SDL_RenderCopy(renderer, lodTexture, &src, &dst);
+}
+
+void renderCellTextures() {
+    if (camera.cellPixels() < LOD_CELL_PIXELS) {
+        renderObstaclesLod(); // Texel-per-cell would alias badly this far out
+        return;
+    }
+    syncCellTextures();
+
+    CellRange r = visibleCells();
+    if (r.x0 >= r.x1 || r.y0 >= r.y1) return;
+    for (int ty = r.y0 / CELL_TILE_SIZE; ty <= (r.y1 - 1) / CELL_TILE_SIZE; ++ty) {
+        for (int tx = r.x0 / CELL_TILE_SIZE; tx <= (r.x1 - 1) / CELL_TILE_SIZE; ++tx) {
+            uploadCellTile(tx, ty);
+            CellTile& tile = cellLayer.tiles[(size_t)ty * cellLayer.tilesX + tx];
+            if (!tile.texture) continue;
+            int w = std::min(CELL_TILE_SIZE, warehouseGrid.cols - tx * CELL_TILE_SIZE);
+            int h = std::min(CELL_TILE_SIZE, warehouseGrid.rows - ty * CELL_TILE_SIZE);
+            SDL_Rect dst = worldRect((double)tx * CELL_TILE_SIZE * GRID_SIZE, (double)ty * CELL_TILE_SIZE * GRID_SIZE,
+                                     (double)w * GRID_SIZE, (double)h * GRID_SIZE);
+            SDL_RenderCopy(renderer, tile.texture, nullptr, &dst);
+        }
+    }
+    renderGrid();
+}
+
+void syncCellTextures() {
+    int tilesX = (warehouseGrid.cols + CELL_TILE_SIZE - 1) / CELL_TILE_SIZE;
+    int tilesY = (warehouseGrid.rows + CELL_TILE_SIZE - 1) / CELL_TILE_SIZE;
+    if (tilesX != cellLayer.tilesX || tilesY != cellLayer.tilesY) {
+        destroyCellTextures();
+        cellLayer.tilesX = tilesX;
+        cellLayer.tilesY = tilesY;
+        cellLayer.tiles.resize((size_t)tilesX * tilesY);
+        cellLayer.version = VIEW_INVALID;
+    }
+    if (cellLayer.version == gridVersion) return;
+
+    size_t first = 0;
+    if (cellLayer.version == VIEW_INVALID || !gridChangesSince(cellLayer.version, first)) {
+        for (auto& tile : cellLayer.tiles) {
+            tile.dirtyMin = 0;
+            tile.dirtyMax = CELL_TILE_SIZE - 1;
+        }
+    } else {
+        for (size_t i = first; i < gridJournal.size(); ++i) {
+            const Point& c = gridJournal[i].cell;
+            CellTile& tile = cellLayer.tiles[(size_t)(c.y / CELL_TILE_SIZE) * tilesX + c.x / CELL_TILE_SIZE];
+            tile.dirtyMin = std::min(tile.dirtyMin, c.y % CELL_TILE_SIZE);
+            tile.dirtyMax = std::max(tile.dirtyMax, c.y % CELL_TILE_SIZE);
+        }
+    }
+    cellLayer.version = gridVersion;
+}
+
+void uploadCellTile(int tx, int ty) {
+    CellTile& tile = cellLayer.tiles[(size_t)ty * cellLayer.tilesX + tx];
+    int w = std::min(CELL_TILE_SIZE, warehouseGrid.cols - tx * CELL_TILE_SIZE);
+    int h = std::min(CELL_TILE_SIZE, warehouseGrid.rows - ty * CELL_TILE_SIZE);
+    if (!tile.texture) {
+        tile.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+        if (!tile.texture) return;
+        SDL_SetTextureScaleMode(tile.texture, SDL_ScaleModeNearest);
+        tile.dirtyMin = 0;
+        tile.dirtyMax = h - 1;
+    }
+    tile.dirtyMax = std::min(tile.dirtyMax, h - 1);
+    if (tile.dirtyMin > tile.dirtyMax) return;
+
+    SDL_Rect rows = {0, tile.dirtyMin, w, tile.dirtyMax - tile.dirtyMin + 1};
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(tile.texture, &rows, &pixels, &pitch) != 0) return;
+    for (int y = 0; y < rows.h; ++y) {
+        Uint32* out = (Uint32*)((Uint8*)pixels + (size_t)y * pitch);
+        int cy = ty * CELL_TILE_SIZE + rows.y + y;
+        for (int x = 0; x < w; ++x) {
+            out[x] = cellColor(tx * CELL_TILE_SIZE + x, cy);
+        }
+    }
+    SDL_UnlockTexture(tile.texture);
+    tile.dirtyMin = INT_MAX;
+    tile.dirtyMax = -1;
+}
+
+void destroyCellTextures() {
+    for (auto& tile : cellLayer.tiles) {
+        if (tile.texture) SDL_DestroyTexture(tile.texture);
+    }
+    cellLayer.tiles.clear();
+    cellLayer.tilesX = cellLayer.tilesY = 0;
+    cellLayer.version = VIEW_INVALID;
+}
+
+Uint32 cellColor(int x, int y) {
+    // Per-cell colour for texture mode; extra layers blend in here
+    return warehouseGrid[y][x] == 1 ? 0xFFC83232u : 0xFF141414u;
+}
+
+void patchStaticCell(const Point& cell) {
+    // Repaint one cell in the same order as a full redraw: background, grid lines, obstacle.
+    // Only the top and left lines belong to this cell; the others may sit under a neighbour.
+    CellRange r = visibleCells();
+    if (cell.x < r.x0 || cell.x >= r.x1 || cell.y < r.y0 || cell.y >= r.y1) return;
+
+    SDL_Rect rect = worldRect(cell.x * GRID_SIZE, cell.y * GRID_SIZE, GRID_SIZE, GRID_SIZE);
+    SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
     SDL_RenderFillRect(renderer, &rect);
+    if (camera.cellPixels() >= MIN_GRID_LINE_SPACING) {
+        SDL_Rect top = {rect.x, rect.y, rect.w, 1};
+        SDL_Rect left = {rect.x, rect.y, 1, rect.h};
+        SDL_SetRenderDrawColor(renderer, 50, 50, 50, 255);
+        SDL_RenderFillRect(renderer, &top);
+        SDL_RenderFillRect(renderer, &left);
+    }
+    if (warehouseGrid[cell.y][cell.x] == 1) {
+        SDL_SetRenderDrawColor(renderer, 200, 50, 50, 255);
+        SDL_RenderFillRect(renderer, &rect);
+    }
+}
+
+void renderRobot() {
+    robotBatch.rects.push_back(worldRect(robot.x - ROBOT_RADIUS, robot.y - ROBOT_RADIUS,
+                                         ROBOT_RADIUS * 2, ROBOT_RADIUS * 2));
+    robotBatch.flush();
 }
 
 void renderDestination() {
     if (hasDestination) {
-        SDL_SetRenderDrawColor(renderer, 50, 50, 200, 255);
-        SDL_Rect rect = {destination.x * GRID_SIZE + GRID_SIZE / 4, destination.y * GRID_SIZE + GRID_SIZE / 4, 
-                         GRID_SIZE / 2, GRID_SIZE / 2};
-        SDL_RenderFillRect(renderer, &rect);
+        markerBatch.rects.push_back(worldRect(destination.x * GRID_SIZE + GRID_SIZE / 4,
+                                              destination.y * GRID_SIZE + GRID_SIZE / 4,
+                                              GRID_SIZE / 2, GRID_SIZE / 2));
+        markerBatch.flush();
     }
 }
 
 void renderPath(const std::vector<Point>& path) {
     if (path.empty()) return;
-    // Draw small rectangles on each cell along the path
-    SDL_SetRenderDrawColor(renderer, 255, 215, 0, 255); // Gold color
+    // Small rectangle on each visible cell along the path, drawn in one batch
+    CellRange r = visibleCells();
     for (const auto& p : path) {
-        SDL_Rect rect = {p.x * GRID_SIZE + GRID_SIZE / 3, p.y * GRID_SIZE + GRID_SIZE / 3, 
-                         GRID_SIZE / 3, GRID_SIZE / 3};
-        SDL_RenderFillRect(renderer, &rect);
+        if (p.x < r.x0 || p.x >= r.x1 || p.y < r.y0 || p.y >= r.y1) continue;
+        pathBatch.rects.push_back(worldRect(p.x * GRID_SIZE + GRID_SIZE / 3, p.y * GRID_SIZE + GRID_SIZE / 3,
+                                            GRID_SIZE / 3, GRID_SIZE / 3));
     }
+    pathBatch.flush();
 }
 
 void renderText(const std::string& message, int x, int y, SDL_Color color) {
-    SDL_Surface* surface = TTF_RenderText_Blended(font, message.c_str(), color);
-    if (!surface) {
-        std::cerr << "Failed to render text surface! TTF_Error: " << TTF_GetError() << std::endl;
-        return;
+    ProfileScope scope(PROFILE_TEXT);
+    if (!glyphAtlas.texture || message.empty()) return;
+
+    // One textured quad per glyph, submitted as a single geometry batch
+    glyphAtlas.vertices.clear();
+    glyphAtlas.indices.clear();
+    int texW = 0, texH = 0;
+    SDL_QueryTexture(glyphAtlas.texture, nullptr, nullptr, &texW, &texH);
+
+    float penX = (float)x;
+    for (char c : message) {
+        int ch = (unsigned char)c;
+        if (ch < ATLAS_FIRST_GLYPH || ch > ATLAS_LAST_GLYPH) ch = '?';
+        const GlyphInfo& g = glyphAtlas.glyphs[ch - ATLAS_FIRST_GLYPH];
+
+        if (g.src.w > 0) {
+            float u0 = (float)g.src.x / texW, v0 = (float)g.src.y / texH;
+            float u1 = (float)(g.src.x + g.src.w) / texW, v1 = (float)(g.src.y + g.src.h) / texH;
+            float x0 = penX, y0 = (float)y;
+            float x1 = penX + g.src.w, y1 = (float)(y + g.src.h);
+
+            int base = (int)glyphAtlas.vertices.size();
+            glyphAtlas.vertices.push_back({{x0, y0}, color, {u0, v0}});
+            glyphAtlas.vertices.push_back({{x1, y0}, color, {u1, v0}});
+            glyphAtlas.vertices.push_back({{x1, y1}, color, {u1, v1}});
+            glyphAtlas.vertices.push_back({{x0, y1}, color, {u0, v1}});
+            int quad[] = {base, base + 1, base + 2, base, base + 2, base + 3};
+            glyphAtlas.indices.insert(glyphAtlas.indices.end(), quad, quad + 6);
+        }
+        penX += g.advance;
     }
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_Rect dstRect = {x, y, surface->w, surface->h};
-    SDL_FreeSurface(surface);
-    SDL_RenderCopy(renderer, texture, nullptr, &dstRect);
-    SDL_DestroyTexture(texture);
+
+    SDL_RenderGeometry(renderer, glyphAtlas.texture,
+                       glyphAtlas.vertices.data(), (int)glyphAtlas.vertices.size(),
+                       glyphAtlas.indices.data(), (int)glyphAtlas.indices.size());
+}
+
+void renderLabel(TextLabel& label, const std::string& message, int x, int y, SDL_Color color) {
+    ProfileScope scope(PROFILE_TEXT);
+    bool sameColor = label.color.r == color.r && label.color.g == color.g &&
+                     label.color.b == color.b && label.color.a == color.a;
+    if (!label.texture || label.text != message || !sameColor) {
+        destroyLabel(label);
+        SDL_Surface* surface = TTF_RenderText_Blended(font, message.c_str(), color);
+        if (!surface) {
+            std::cerr << "Failed to render text surface! TTF_Error: " << TTF_GetError() << std::endl;
+            return;
+        }
+        label.texture = SDL_CreateTextureFromSurface(renderer, surface);
+        label.w = surface->w;
+        label.h = surface->h;
+        label.text = message;
+        label.color = color;
+        SDL_FreeSurface(surface);
+        if (!label.texture) return;
+    }
+    SDL_Rect dstRect = {x, y, label.w, label.h};
+    SDL_RenderCopy(renderer, label.texture, nullptr, &dstRect);
+}
+
+void destroyLabel(TextLabel& label) {
+    if (label.texture) SDL_DestroyTexture(label.texture);
+    label.texture = nullptr;
+    label.text.clear();
+}
+
+bool buildGlyphAtlas() {
+    SDL_Color white = {255, 255, 255, 255};
+    int lineHeight = TTF_FontHeight(font);
+    int rows = 1, penX = 0;
+
+    // First pass: rasterize every glyph and work out the atlas height
+    std::vector<SDL_Surface*> surfaces;
+    for (int ch = ATLAS_FIRST_GLYPH; ch <= ATLAS_LAST_GLYPH; ++ch) {
+        GlyphInfo& g = glyphAtlas.glyphs[ch - ATLAS_FIRST_GLYPH];
+        int minX, maxX, minY, maxY, advance;
+        g.advance = TTF_GlyphMetrics(font, (Uint16)ch, &minX, &maxX, &minY, &maxY, &advance) == 0 ? advance : 0;
+        g.src = {0, 0, 0, 0};
+
+        SDL_Surface* surface = TTF_RenderGlyph_Blended(font, (Uint16)ch, white);
+        surfaces.push_back(surface);
+        if (!surface) continue;
+        if (penX + surface->w > ATLAS_WIDTH) {
+            ++rows;
+            penX = 0;
+        }
+        g.src = {penX, (rows - 1) * lineHeight, surface->w, surface->h};
+        penX += surface->w + 1;
+    }
+
+    SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, rows * lineHeight, 32,
+                                                        SDL_PIXELFORMAT_ARGB8888);
+    if (atlas) {
+        SDL_FillRect(atlas, nullptr, SDL_MapRGBA(atlas->format, 255, 255, 255, 0));
+        for (int ch = ATLAS_FIRST_GLYPH; ch <= ATLAS_LAST_GLYPH; ++ch) {
+            SDL_Surface* surface = surfaces[ch - ATLAS_FIRST_GLYPH];
+            if (!surface) continue;
+            SDL_Rect dst = glyphAtlas.glyphs[ch - ATLAS_FIRST_GLYPH].src;
+            SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE); // Copy coverage as-is
+            SDL_BlitSurface(surface, nullptr, atlas, &dst);
+        }
+        glyphAtlas.texture = SDL_CreateTextureFromSurface(renderer, atlas);
+        SDL_FreeSurface(atlas);
+    }
+    for (SDL_Surface* surface : surfaces) {
+        if (surface) SDL_FreeSurface(surface);
+    }
+    if (!glyphAtlas.texture) return false;
+
+    SDL_SetTextureBlendMode(glyphAtlas.texture, SDL_BLENDMODE_BLEND);
+    glyphAtlas.vertices.reserve(4 * 128);
+    glyphAtlas.indices.reserve(6 * 128);
+    return true;
+}
+
+void destroyGlyphAtlas() {
+    if (glyphAtlas.texture) SDL_DestroyTexture(glyphAtlas.texture);
+    glyphAtlas.texture = nullptr;
 }
 
 void renderInstructions() {
     SDL_Color white = {255, 255, 255, 255};
     std::string algo = useAStar ? "A*" : "BFS";
-    renderText("Left Click: Set Destination   Right Click: Toggle Obstacle", 10, 5, white);
-    renderText("R: Reset   T: Toggle Algorithm   (Current: " + algo + ")", 10, 25, white);
-    renderText("S: Save Layout   L: Load Layout", 10, 45, white);
+    renderLabel(instructionLabels[0], "Left Click: Set Destination   Right Click: Toggle Obstacle", 10, 5, white);
+    renderLabel(instructionLabels[1], "R: Reset   T: Toggle Algorithm   (Current: " + algo + ")   I: Search Stats (" +
+                (collectSearchStats ? "On" : "Off") + ")", 10, 25, white);
+    renderLabel(instructionLabels[2], "S: Save Layout (Shift: Text)   L: Load Layout   D: Dump Latency", 10, 45, white);
+    std::string mode = useCellTextures ? "Texture" : "Rects";
+    renderLabel(instructionLabels[3], "Wheel: Zoom   Drag/Arrows: Pan   F: Fit   V: Render (" + mode + ")", 10, 65, white);
+    std::string search = showSearch ? "On, " + std::to_string(searchEventsPerFrame) + "/frame" : "Off";
+    if (showSearch && searchEventsDropped) search += ", " + std::to_string(searchEventsDropped) + " dropped";
+    renderLabel(instructionLabels[4], "E: Show Search (" + search + ")   [ ]: Animation Speed   J: Trace (" +
+                (spanTrace.recording ? "Recording" : "Off") + ")", 10, 85, white);
+    renderLabel(instructionLabels[5], std::string("H: Heatmap (") + (showHeatmap ? "On" : "Off") +
+                ")   X: Export Heatmap   C: Congestion Cost (" + (useCongestionCost ? "On" : "Off") + ")",
+                10, 105, white);
+    std::string stats = searchStatsSummary();
+    if (!stats.empty()) renderLabel(instructionLabels[6], stats, 10, 125, white);
+}
+
+bool isInsideGrid(int x, int y) {
+    return x >= 0 && x < warehouseGrid.cols && y >= 0 && y < warehouseGrid.rows;
 }
 
 bool isValidGridPosition(int x, int y) {
-    return x >= 0 && x < COLS && y >= 0 && y < ROWS && warehouseGrid[y][x] == 0;
+    return isInsideGrid(x, y) && warehouseGrid[y][x] == 0;
+}
+
+void setCell(int x, int y, int value) {
+    if (!isInsideGrid(x, y) || warehouseGrid[y][x] == value) return;
+    warehouseGrid[y][x] = value;
+    ++gridVersion;
+    if (gridJournal.size() >= GRID_JOURNAL_LIMIT) {
+        gridJournal.erase(gridJournal.begin(), gridJournal.begin() + GRID_JOURNAL_LIMIT / 2);
+    }
+    gridJournal.push_back({gridVersion, {x, y}});
+    updatePyramid(x, y);
+}
+
+void markGridDirty() {
+    ++gridVersion;
+    gridResetVersion = gridVersion;
+    gridJournal.clear();
+    occupancyPyramid.levels.clear(); // Rebuilt lazily on the next zoomed-out frame
+}
+
+// Finds the journal entries newer than `version`. Returns false when the view is too far behind
+// (a whole-grid change happened or the entries were trimmed) and must redraw from scratch.
+bool gridChangesSince(unsigned long long version, size_t& firstIndex) {
+    if (version < gridResetVersion) return false;
+    if (!gridJournal.empty() && gridJournal.front().version > version + 1) return false;
+    auto it = std::upper_bound(gridJournal.begin(), gridJournal.end(), version,
+                               [](unsigned long long v, const GridChange& c) { return v < c.version; });
+    firstIndex = (size_t)(it - gridJournal.begin());
+    return true;
+}
+
+int pyramidCoverage(int level, int x, int y) {
+    if (level == 0) return warehouseGrid[y][x] ? 255 : 0;
+    const OccupancyPyramid::Level& lv = occupancyPyramid.levels[level];
+    return lv.coverage[(size_t)y * lv.cols + x];
+}
+
+// Recompute one pyramid cell as the mean of its (up to four) children on the level below
+void reducePyramidCell(int level, int x, int y) {
+    const OccupancyPyramid::Level& below = occupancyPyramid.levels[level - 1];
+    OccupancyPyramid::Level& lv = occupancyPyramid.levels[level];
+    int sum = 0, count = 0;
+    for (int cy = 2 * y; cy < std::min(2 * y + 2, below.rows); ++cy) {
+        for (int cx = 2 * x; cx < std::min(2 * x + 2, below.cols); ++cx) {
+            sum += pyramidCoverage(level - 1, cx, cy);
+            ++count;
+        }
+    }
+    lv.coverage[(size_t)y * lv.cols + x] = (unsigned char)((sum + count / 2) / count);
+}
+
+// Allocates every level with no rows built; buildPyramid fills them in
+void resetPyramid() {
+    occupancyPyramid.levels.clear();
+    OccupancyPyramid::Level base;
+    base.rows = warehouseGrid.rows;
+    base.cols = warehouseGrid.cols;
+    base.rowsBuilt = base.rows;
+    occupancyPyramid.levels.push_back(base);
+
+    while (occupancyPyramid.levels.back().rows > 1 || occupancyPyramid.levels.back().cols > 1) {
+        const OccupancyPyramid::Level& below = occupancyPyramid.levels.back();
+        OccupancyPyramid::Level lv;
+        lv.rows = (below.rows + 1) / 2;
+        lv.cols = (below.cols + 1) / 2;
+        lv.coverage.resize((size_t)lv.rows * lv.cols);
+        occupancyPyramid.levels.push_back(std::move(lv));
+    }
+}
+
+// Reduces up to `budget` grid cells into level 1. Higher levels follow as far as the rows below
+// them are complete; they add at most a third of the level 1 work.
+void buildPyramid(size_t budget) {
+    for (int level = 1; level < (int)occupancyPyramid.levels.size(); ++level) {
+        OccupancyPyramid::Level& lv = occupancyPyramid.levels[level];
+        const OccupancyPyramid::Level& below = occupancyPyramid.levels[level - 1];
+        while (lv.rowsBuilt < lv.rows && below.rowsBuilt >= std::min(2 * lv.rowsBuilt + 2, below.rows)) {
+            if (level == 1) {
+                if (budget == 0) break;
+                budget -= std::min(budget, (size_t)below.cols * 2);
+            }
+            for (int x = 0; x < lv.cols; ++x) reducePyramidCell(level, x, lv.rowsBuilt);
+            ++lv.rowsBuilt;
+        }
+    }
+}
+
+bool pyramidBuilding() {
+    return !occupancyPyramid.levels.empty() && occupancyPyramid.levels.back().rowsBuilt < occupancyPyramid.levels.back().rows;
+}
+
+void updatePyramid(int x, int y) {
+    // Walk up the single chain of ancestors: O(log n) per edit. Rows not built yet are
+    // computed from the current grid when the builder reaches them.
+    for (int level = 1; level < (int)occupancyPyramid.levels.size(); ++level) {
+        x /= 2;
+        y /= 2;
+        if (y >= occupancyPyramid.levels[level].rowsBuilt) break;
+        reducePyramidCell(level, x, y);
+    }
+}
+
+std::vector<Point> planPath(Point start, Point end) {
+    ProfileScope scope(PROFILE_PLAN);
+    std::vector<Point> path;
+    if (collectSearchStats) {
+        SearchStatsTracer stats;
+        if (showSearch) {
+            RingSearchTracer ring;
+            TeeSearchTracer<RingSearchTracer, SearchStatsTracer> tracer{ring, stats};
+            path = runPlanner(start, end, tracer);
+        } else {
+            path = runPlanner(start, end, stats);
+        }
+        recordSearchStats(useAStar, stats.stats);
+    } else if (showSearch) {
+        RingSearchTracer tracer;
+        path = runPlanner(start, end, tracer);
+    } else {
+        path = useAStar ? findPathA(start, end) : findPath(start, end);
+    }
+    if (pathExporter.file) exportPath(start, end, path);
+    return path;
 }
 
 std::vector<Point> findPath(Point start, Point end) {
-    std::vector<std::vector<bool>> visited(ROWS, std::vector<bool>(COLS, false));
-    std::vector<std::vector<Point>> parents(ROWS, std::vector<Point>(COLS, {-1, -1}));
+    NullSearchTracer tracer;
+    return bfsSearch(start, end, tracer);
+}
+
+std::vector<Point> findPathA(Point start, Point end) {
+    NullSearchTracer tracer;
+    return aStarSearch(start, end, tracer);
+}
+
+template <typename Tracer>
+std::vector<Point> runPlanner(Point start, Point end, Tracer& tracer) {
+    return useAStar ? aStarSearch(start, end, tracer) : bfsSearch(start, end, tracer);
+}
+
+template <typename Tracer>
+std::vector<Point> bfsSearch(Point start, Point end, Tracer& tracer) {
+    tracer.begin();
+    const int rows = warehouseGrid.rows, cols = warehouseGrid.cols;
+    std::vector<std::vector<bool>> visited(rows, std::vector<bool>(cols, false));
+    std::vector<std::vector<Point>> parents(rows, std::vector<Point>(cols, {-1, -1}));
+    tracer.allocated((size_t)rows * ((cols + 7) / 8 + cols * sizeof(Point)));
 
     std::queue<Point> queue;
     queue.push(start);
     visited[start.y][start.x] = true;
+    tracer.opened(start.x, start.y);
+    tracer.queued(queue.size(), sizeof(Point));
 
     const int dx[] = {0, 1, 0, -1};
     const int dy[] = {-1, 0, 1, 0};
@@ -336,6 +2303,7 @@ std::vector<Point> findPath(Point start, Point end) {
     while (!queue.empty()) {
         Point current = queue.front();
         queue.pop();
+        tracer.closed(current.x, current.y);
 
         if (current == end) {
             std::vector<Point> path;
@@ -344,6 +2312,7 @@ std::vector<Point> findPath(Point start, Point end) {
                 current = parents[current.y][current.x];
             }
             std::reverse(path.begin(), path.end());
+            tracer.finished(path.size());
             return path;
         }
 
@@ -355,16 +2324,22 @@ std::vector<Point> findPath(Point start, Point end) {
                 queue.push({nx, ny});
                 visited[ny][nx] = true;
                 parents[ny][nx] = current;
+                tracer.opened(nx, ny);
+                tracer.queued(queue.size(), sizeof(Point));
             }
         }
     }
 
+    tracer.finished(0);
     return {}; // No path found
 }
 
-std::vector<Point> findPathA(Point start, Point end) {
-    std::vector<std::vector<bool>> visited(ROWS, std::vector<bool>(COLS, false));
-    std::vector<std::vector<Point>> parents(ROWS, std::vector<Point>(COLS, {-1, -1}));
+template <typename Tracer>
+std::vector<Point> aStarSearch(Point start, Point end, Tracer& tracer) {
+    tracer.begin();
+    const int rows = warehouseGrid.rows, cols = warehouseGrid.cols;
+    std::vector<std::vector<bool>> visited(rows, std::vector<bool>(cols, false));
+    std::vector<std::vector<Point>> parents(rows, std::vector<Point>(cols, {-1, -1}));
 
     // Priority queue with custom comparator for f-cost
     auto comparator = [](const std::pair<Point, int>& a, const std::pair<Point, int>& b) {
@@ -373,10 +2348,13 @@ std::vector<Point> findPathA(Point start, Point end) {
     std::priority_queue<std::pair<Point, int>, std::vector<std::pair<Point, int>>, decltype(comparator)> openList(comparator);
     
     // gCost tracking
-    std::vector<std::vector<int>> gCost(ROWS, std::vector<int>(COLS, INT_MAX));
+    std::vector<std::vector<int>> gCost(rows, std::vector<int>(cols, INT_MAX));
+    tracer.allocated((size_t)rows * ((cols + 7) / 8 + cols * (sizeof(Point) + sizeof(int))));
     
     openList.push({start, 0});
     gCost[start.y][start.x] = 0;
+    tracer.opened(start.x, start.y);
+    tracer.queued(openList.size(), sizeof(std::pair<Point, int>));
 
     const int dx[] = {0, 1, 0, -1};
     const int dy[] = {-1, 0, 1, 0};
@@ -392,9 +2370,11 @@ std::vector<Point> findPathA(Point start, Point end) {
                 current = parents[current.y][current.x];
             }
             std::reverse(path.begin(), path.end());
+            tracer.finished(path.size());
             return path;
         }
 
+        if (!visited[current.y][current.x]) tracer.closed(current.x, current.y);
         visited[current.y][current.x] = true;
 
         for (int i = 0; i < 4; ++i) {
@@ -402,48 +2382,2377 @@ std::vector<Point> findPathA(Point start, Point end) {
             int ny = current.y + dy[i];
 
             if (isValidGridPosition(nx, ny) && !visited[ny][nx]) {
-                int newGCost = gCost[current.y][current.x] + 1;
+                int newGCost = gCost[current.y][current.x] + 1 + warehouseGrid.cost(nx, ny) + congestionPenalty(nx, ny);
                 int hCost = std::abs(nx - end.x) + std::abs(ny - end.y);
                 int fCost = newGCost + hCost;
 
                 if (newGCost < gCost[ny][nx]) {
+                    if (gCost[ny][nx] != INT_MAX) tracer.reopened(nx, ny);
                     parents[ny][nx] = current;
                     gCost[ny][nx] = newGCost;
                     openList.push({{nx, ny}, fCost});
+                    tracer.opened(nx, ny);
+                    tracer.queued(openList.size(), sizeof(std::pair<Point, int>));
                 }
             }
         }
     }
+    tracer.finished(0);
     return {}; // No path found
 }
 
-void saveLayout(const std::string& filename) {
+void resetTraffic(int rows, int cols) {
+    for (auto& shard : traffic.shards) {
+        std::lock_guard<std::mutex> lock(shard.allocating);
+        shard.allocated.store(false, std::memory_order_relaxed);
+        shard.visits = std::vector<std::atomic<unsigned int>>();
+        shard.waitFrames = std::vector<std::atomic<unsigned short>>();
+        shard.peakHeat.store(0, std::memory_order_relaxed);
+    }
+    traffic.rows = rows;
+    traffic.cols = cols;
+}
+
+void allocateTrafficShard(TrafficShard& shard) {
+    std::lock_guard<std::mutex> lock(shard.allocating);
+    if (shard.allocated.load(std::memory_order_relaxed)) return;
+    size_t cells = (size_t)traffic.rows * traffic.cols;
+    shard.visits = std::vector<std::atomic<unsigned int>>(cells);
+    shard.waitFrames = std::vector<std::atomic<unsigned short>>(cells);
+    shard.allocated.store(true, std::memory_order_release);
+}
+
+TrafficShardOwner& localTrafficShard() {
+    TrafficShardOwner& owner = trafficShardOwner;
+    if (owner.shard) return owner;
+    for (int i = 0; i < TRAFFIC_SHARED_SHARD && !owner.shard; ++i) {
+        bool expected = false;
+        if (traffic.shards[i].owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            owner.shard = &traffic.shards[i];
+            owner.exclusive = true;
+        }
+    }
+    if (!owner.shard) owner.shard = &traffic.shards[TRAFFIC_SHARED_SHARD];
+    return owner;
+}
+
+void recordTraffic(bool wait, int x, int y) {
+    // Counters are (re)allocated lazily by the simulation thread, so loading a map stays cheap
+    if (!trafficMatchesGrid()) resetTraffic(warehouseGrid.rows, warehouseGrid.cols);
+    if (!isInsideGrid(x, y)) return;
+
+    TrafficShardOwner& owner = localTrafficShard();
+    TrafficShard& shard = *owner.shard;
+    if (!shard.allocated.load(std::memory_order_acquire)) allocateTrafficShard(shard);
+    size_t i = (size_t)y * traffic.cols + x;
+    if (wait)
+        TrafficShard::bump(shard.waitFrames[i], owner.exclusive);
+    else
+        TrafficShard::bump(shard.visits[i], owner.exclusive);
+    TrafficShard::bump(shard.writes, owner.exclusive);
+
+    unsigned int heat = shard.visits[i].load(std::memory_order_relaxed) +
+                        shard.waitFrames[i].load(std::memory_order_relaxed) / WAIT_FRAMES_PER_VISIT;
+    unsigned int peak = shard.peakHeat.load(std::memory_order_relaxed);
+    while (heat > peak && !shard.peakHeat.compare_exchange_weak(peak, heat, std::memory_order_relaxed)) {}
+}
+
+void recordVisit(int x, int y) {
+    recordTraffic(false, x, y);
+}
+
+void recordWait(int x, int y) {
+    recordTraffic(true, x, y);
+}
+
+bool trafficMatchesGrid() {
+    return traffic.rows == warehouseGrid.rows && traffic.cols == warehouseGrid.cols;
+}
+
+unsigned int trafficVisits(int x, int y) {
+    if (!trafficMatchesGrid() || !isInsideGrid(x, y)) return 0;
+    size_t i = (size_t)y * traffic.cols + x;
+    unsigned int total = 0;
+    for (auto& shard : traffic.shards) {
+        if (shard.allocated.load(std::memory_order_acquire)) total += shard.visits[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+unsigned int trafficWaitFrames(int x, int y) {
+    if (!trafficMatchesGrid() || !isInsideGrid(x, y)) return 0;
+    size_t i = (size_t)y * traffic.cols + x;
+    unsigned int total = 0;
+    for (auto& shard : traffic.shards) {
+        if (shard.allocated.load(std::memory_order_acquire)) total += shard.waitFrames[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+unsigned int trafficHeat(int x, int y) {
+    return trafficVisits(x, y) + trafficWaitFrames(x, y) / WAIT_FRAMES_PER_VISIT;
+}
+
+unsigned int trafficWrites() {
+    unsigned int total = 0;
+    for (auto& shard : traffic.shards) total += shard.writes.load(std::memory_order_relaxed);
+    return total;
+}
+
+int congestionPenalty(int x, int y) {
+    if (!useCongestionCost) return 0;
+    return std::min(MAX_CONGESTION_PENALTY, (int)(trafficHeat(x, y) / HEAT_PER_PENALTY_STEP));
+}
+
+Uint32 heatColor(unsigned int heat, unsigned int peak) {
+    // Transparent for cold cells, then blue -> yellow -> red as traffic approaches the peak
+    if (heat == 0 || peak == 0) return 0;
+    float t = std::min(1.0f, (float)heat / peak);
+    Uint32 r, g, b;
+    if (t < 0.5f) {
+        r = (Uint32)(510 * t);
+        g = (Uint32)(510 * t);
+        b = (Uint32)(255 * (1 - 2 * t));
+    } else {
+        r = 255;
+        g = (Uint32)(255 * (2 - 2 * t));
+        b = 0;
+    }
+    Uint32 a = 90 + (Uint32)(130 * t);
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+void renderHeatmap() {
+    if (!trafficMatchesGrid()) return;
+    if (camera.cellPixels() < LOD_CELL_PIXELS) return; // Cells too small to read
+
+    const int maxW = (int)(SCREEN_WIDTH / LOD_CELL_PIXELS) + 2;
+    const int maxH = (int)(SCREEN_HEIGHT / LOD_CELL_PIXELS) + 2;
+    if (!heatmapOverlay.texture) {
+        heatmapOverlay.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                                   SDL_TEXTUREACCESS_STREAMING, maxW, maxH);
+        if (!heatmapOverlay.texture) return;
+        SDL_SetTextureBlendMode(heatmapOverlay.texture, SDL_BLENDMODE_BLEND);
+        SDL_SetTextureScaleMode(heatmapOverlay.texture, SDL_ScaleModeNearest);
+    }
+
+    CellRange r = visibleCells();
+    int w = std::min(r.x1 - r.x0, maxW), h = std::min(r.y1 - r.y0, maxH);
+    if (w <= 0 || h <= 0) return;
+    CellRange& win = heatmapOverlay.window;
+    bool moved = win.x0 != r.x0 || win.y0 != r.y0 || win.x1 != r.x1 || win.y1 != r.y1;
+
+    unsigned int writes = trafficWrites();
+    bool changed = writes != heatmapOverlay.mergedWrites;
+    if (moved || (changed && --heatmapOverlay.framesUntilRefresh <= 0)) {
+        heatmapOverlay.framesUntilRefresh = HEATMAP_REFRESH_FRAMES;
+        heatmapOverlay.mergedWrites = writes;
+        if (moved) {
+            win = r;
+            heatmapOverlay.texels.assign((size_t)maxW * maxH, 1); // Never a real colour: forces upload
+        }
+
+        unsigned int peak = 0;
+        for (auto& shard : traffic.shards) peak += shard.peakHeat.load(std::memory_order_relaxed);
+
+        // Merge the shards for the visible cells and note which rows actually changed
+        int dirtyMin = INT_MAX, dirtyMax = -1;
+        for (int y = 0; y < h; ++y) {
+            Uint32* row = heatmapOverlay.texels.data() + (size_t)y * maxW;
+            for (int x = 0; x < w; ++x) {
+                Uint32 c = heatColor(trafficHeat(r.x0 + x, r.y0 + y), peak);
+                if (c != row[x]) {
+                    row[x] = c;
+                    dirtyMin = std::min(dirtyMin, y);
+                    dirtyMax = std::max(dirtyMax, y);
+                }
+            }
+        }
+
+        if (dirtyMax >= 0) {
+            SDL_Rect rows = {0, dirtyMin, w, dirtyMax - dirtyMin + 1};
+            void* pixels;
+            int pitch;
+            if (SDL_LockTexture(heatmapOverlay.texture, &rows, &pixels, &pitch) == 0) {
+                for (int y = 0; y < rows.h; ++y) {
+                    SDL_memcpy((Uint8*)pixels + (size_t)y * pitch,
+                               heatmapOverlay.texels.data() + (size_t)(rows.y + y) * maxW, w * sizeof(Uint32));
+                }
+                SDL_UnlockTexture(heatmapOverlay.texture);
+            }
+        }
+    }
+
+    SDL_Rect src = {0, 0, w, h};
+    SDL_Rect dst = worldRect((double)r.x0 * GRID_SIZE, (double)r.y0 * GRID_SIZE,
+                             (double)w * GRID_SIZE, (double)h * GRID_SIZE);
+    SDL_RenderCopy(renderer, heatmapOverlay.texture, &src, &dst);
+}
+
+void exportHeatmap(const std::string& filename) {
     std::ofstream ofs(filename);
     if (!ofs) {
-        std::cerr << "Error saving layout to file!" << std::endl;
+        std::cerr << "Error exporting heatmap to file!" << std::endl;
         return;
     }
-    for (const auto& row : warehouseGrid) {
-        for (int cell : row) {
-            ofs << cell << " ";
+    // Sparse CSV: only cells that saw any traffic
+    ofs << "x,y,visits,wait_frames\n";
+    for (int y = 0; y < traffic.rows; ++y) {
+        for (int x = 0; x < traffic.cols; ++x) {
+            unsigned int visits = trafficVisits(x, y), wait = trafficWaitFrames(x, y);
+            if (visits || wait) ofs << x << "," << y << "," << visits << "," << wait << "\n";
         }
-        ofs << "\n";
     }
     ofs.close();
-    std::cout << "Layout saved to " << filename << std::endl;
+    std::cout << "Heatmap exported to " << filename << std::endl;
 }
 
-void loadLayout(const std::string& filename) {
-    std::ifstream ifs(filename);
-    if (!ifs) {
-        std::cerr << "Error loading layout from file!" << std::endl;
-        return;
+void waitUntil(Uint64 deadline) {
+    // Coarse sleep for the bulk of the wait, then yield through the last millisecond
+    const Uint64 frequency = SDL_GetPerformanceFrequency();
+    for (;;) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now >= deadline) return;
+        Uint64 remainingMs = (deadline - now) * 1000 / frequency;
+        SDL_Delay(remainingMs > 1 ? (Uint32)(remainingMs - 1) : 0);
     }
-    for (int i = 0; i < ROWS; ++i) {
-        for (int j = 0; j < COLS; ++j) {
-            ifs >> warehouseGrid[i][j];
+}
+
+void RingSearchTracer::emit(const SearchEvent& ev) {
+    if (!searchEvents.push(ev)) ++searchEventsDropped;
+}
+
+void drainSearchEvents(int budget) {
+    size_t cells = (size_t)warehouseGrid.rows * warehouseGrid.cols;
+    if (searchOverlay.size() != cells) searchOverlay.assign(cells, 0);
+
+    SearchEvent ev;
+    while (budget-- > 0 && searchEvents.pop(ev)) {
+        if (ev.type == SEARCH_BEGIN) {
+            std::fill(searchOverlay.begin(), searchOverlay.end(), 0);
+        } else if (isInsideGrid(ev.x, ev.y)) {
+            searchOverlay[(size_t)ev.y * warehouseGrid.cols + ev.x] = ev.type == SEARCH_OPENED ? 1 : 2;
         }
     }
-    ifs.close();
+}
+
+void renderSearchOverlay() {
+    if (searchOverlay.empty()) return;
+    CellRange r = visibleCells();
+    for (int i = r.y0; i < r.y1; ++i) {
+        const unsigned char* row = searchOverlay.data() + (size_t)i * warehouseGrid.cols;
+        for (int j = r.x0; j < r.x1; ++j) {
+            if (row[j] == 0) continue;
+            SDL_Rect rect = worldRect(j * GRID_SIZE, i * GRID_SIZE, GRID_SIZE, GRID_SIZE);
+            (row[j] == 1 ? openBatch : closedBatch).rects.push_back(rect);
+        }
+    }
+    closedBatch.flush();
+    openBatch.flush();
+}
+
+void clearSearchOverlay() {
+    SearchEvent ev;
+    while (searchEvents.pop(ev)) {}
+    searchOverlay.clear();
+    searchEventsDropped = 0;
+}
+
+// Binary layout format (all integers little-endian):
+//   "WHLY" | u16 version | u8 encoding | u8 layers | u32 rows | u32 cols | payload | u32 CRC-32
+// The occupancy payload is row-major: LAYOUT_ENCODING_BITS packs eight cells per byte, least
+// significant bit first; LAYOUT_ENCODING_BYTES stores one byte per cell so the planner can use a
+// mapped file directly; LAYOUT_ENCODING_RUNS stores each row as varint run lengths that alternate
+// free/obstacle, starting with a (possibly empty) free run. With LAYOUT_LAYER_COST set, one cost
+// byte per cell follows, or for the run encoding (value, varint length) pairs per row. The CRC
+// covers every byte before it.
+const char LAYOUT_MAGIC[4] = {'W', 'H', 'L', 'Y'};
+const int LAYOUT_VERSION = 1;
+const int LAYOUT_HEADER_BYTES = 16;
+const unsigned char LAYOUT_ENCODING_BITS = 1;
+const unsigned char LAYOUT_ENCODING_BYTES = 2;
+const unsigned char LAYOUT_ENCODING_RUNS = 3;
+const unsigned char LAYOUT_LAYER_OCCUPANCY = 1 << 0;
+const unsigned char LAYOUT_LAYER_COST = 1 << 1;
+
+Uint32 crc32(const unsigned char* data, size_t size) {
+    static Uint32 table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (Uint32 i = 0; i < 256; ++i) {
+            Uint32 c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+    Uint32 crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void putLE(std::vector<unsigned char>& out, Uint32 value, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back((unsigned char)(value >> (8 * i)));
+}
+
+Uint32 getLE(const unsigned char* in, int bytes) {
+    Uint32 value = 0;
+    for (int i = 0; i < bytes; ++i) value |= (Uint32)in[i] << (8 * i);
+    return value;
+}
+
+bool isTextLayoutFile(const std::string& filename) {
+    return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".txt") == 0;
+}
+
+bool isMappableLayoutFile(const std::string& filename) {
+    return filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".grid") == 0;
+}
+
+void saveLayoutAsync(const std::string& filename) {
+    if (inputReplay.active) return; // Replays don't overwrite the user's files
+    if (filename == LAYOUT_FILE && journaledLoad.queued) {
+        journaledLoad.saveAfter = true; // The grid on screen is about to be replaced by the load
+        return;
+    }
+
+    // The snapshot is two memcpys; encoding and every file write happen on the writer thread
+    SaveJob job(filename);
+    const Grid& g = warehouseGrid;
+    size_t cells = (size_t)g.rows * g.cols;
+    job.snapshot.rows = g.rows;
+    job.snapshot.cols = g.cols;
+    job.snapshot.cells.assign(g.data(), g.data() + cells);
+    if (const unsigned char* costs = g.costData()) job.snapshot.costs.assign(costs, costs + cells);
+
+    // Saving the journaled layout folds the journal into it; the first save starts one
+    if (filename == LAYOUT_FILE) {
+        std::lock_guard<std::mutex> lock(layoutJournal.mutex);
+        if (layoutJournal.file || layoutJournal.starting) {
+            job.compactJournal = true;
+            job.journalRecords = layoutJournal.trimmed + layoutJournal.records;
+            layoutJournal.compacting = true;
+        } else {
+            job.startJournal = true;
+            layoutJournal.starting = true;
+        }
+    }
+
+    LayoutSaver& saver = layoutSaver;
+    {
+        std::lock_guard<std::mutex> lock(saver.mutex);
+        saver.jobs.push_back(std::move(job));
+        ++saver.pending;
+        saver.stopping = false;
+        if (!saver.writer.joinable()) saver.writer = std::thread(layoutSaverLoop);
+    }
+    saver.changed.notify_all();
+}
+
+void layoutSaverLoop() {
+    LayoutSaver& saver = layoutSaver;
+    traceThreadName = "layout saver";
+    for (;;) {
+        SaveJob job;
+        {
+            std::unique_lock<std::mutex> lock(saver.mutex);
+            saver.changed.wait(lock, [&] { return saver.stopping || !saver.jobs.empty(); });
+            if (saver.jobs.empty()) return; // Stopping and fully drained
+            job = std::move(saver.jobs.front());
+            saver.jobs.pop_front();
+        }
+        if (job.loadJournaled) {
+            loadJournaledLayout();
+            continue;
+        }
+
+        TraceScope trace("save layout");
+        std::vector<unsigned char> out;
+        encodeLayout(job.snapshot, job.filename, out);
+        Uint32 crc = getLE(out.data() + out.size() - 4, 4);
+        bool ok = (!job.compactJournal || setJournalNextCrc(crc)) && writeFileAtomic(job.filename, out);
+        if (ok && job.compactJournal) trimJournal(job.journalRecords, crc);
+        if (job.startJournal) startJournal(ok, crc);
+        if (job.compactJournal) {
+            std::lock_guard<std::mutex> lock(layoutJournal.mutex);
+            layoutJournal.compacting = false;
+        }
+        if (!ok) std::cerr << "Error saving layout to " << job.filename << std::endl;
+
+        {
+            std::lock_guard<std::mutex> lock(saver.mutex);
+            --saver.pending;
+            saver.status = (ok ? "Layout saved to " : "Error saving layout to ") + job.filename;
+            saver.statusTicks = SDL_GetTicks();
+        }
+        saver.changed.notify_all();
+        // Wake the event loop so the HUD shows the result even when idle
+        SDL_Event done = {};
+        done.type = SDL_USEREVENT;
+        SDL_PushEvent(&done);
+    }
+}
+
+void stopLayoutSaver() {
+    LayoutSaver& saver = layoutSaver;
+    {
+        std::lock_guard<std::mutex> lock(saver.mutex);
+        saver.stopping = true;
+    }
+    saver.changed.notify_all();
+    if (saver.writer.joinable()) saver.writer.join();
+}
+
+bool saveStatusVisible() {
+    std::lock_guard<std::mutex> lock(layoutSaver.mutex);
+    return layoutSaver.pending > 0 ||
+           (!layoutSaver.status.empty() && SDL_GetTicks() - layoutSaver.statusTicks < SAVE_STATUS_MS);
+}
+
+void renderSaveStatus() {
+    std::string message;
+    {
+        std::lock_guard<std::mutex> lock(layoutSaver.mutex);
+        if (layoutSaver.pending > 0)
+            message = "Saving layout...";
+        else if (!layoutSaver.status.empty() && SDL_GetTicks() - layoutSaver.statusTicks < SAVE_STATUS_MS)
+            message = layoutSaver.status;
+    }
+    if (!message.empty()) renderText(message, 10, SCREEN_HEIGHT - 25, {255, 255, 255, 255});
+}
+
+// Binary layouts by default, the text format for .txt and byte-per-cell for mappable .grid files
+void encodeLayout(const Grid& g, const std::string& filename, std::vector<unsigned char>& out) {
+    size_t cells = (size_t)g.rows * g.cols;
+    const unsigned char* data = g.data();
+    out.clear();
+
+    // The text format stays available as an import/export path
+    if (isTextLayoutFile(filename)) {
+        out.reserve(cells * 2 + g.rows);
+        for (int y = 0; y < g.rows; ++y) {
+            const unsigned char* row = data + (size_t)y * g.cols;
+            for (int x = 0; x < g.cols; ++x) {
+                out.push_back(row[x] ? '1' : '0');
+                out.push_back(' ');
+            }
+            out.push_back('\n');
+        }
+        return;
+    }
+
+    const unsigned char* costs = g.costData();
+    bool bytes = isMappableLayoutFile(filename);
+    LayoutHeader header = {LAYOUT_VERSION, bytes ? LAYOUT_ENCODING_BYTES : LAYOUT_ENCODING_RUNS,
+                           LAYOUT_LAYER_OCCUPANCY | (costs ? LAYOUT_LAYER_COST : 0), (Uint32)g.rows, (Uint32)g.cols};
+    if (bytes) out.reserve(layoutFileSize(header));
+    out.insert(out.end(), LAYOUT_MAGIC, LAYOUT_MAGIC + 4);
+    putLE(out, (Uint32)header.version, 2);
+    putLE(out, (Uint32)header.encoding, 1);
+    putLE(out, (Uint32)header.layers, 1);
+    putLE(out, header.rows, 4);
+    putLE(out, header.cols, 4);
+
+    if (bytes) {
+        out.insert(out.end(), data, data + cells);
+        if (costs) out.insert(out.end(), costs, costs + cells);
+    } else {
+        for (int y = 0; y < g.rows; ++y) encodeRuns(data + (size_t)y * g.cols, g.cols, out);
+        if (costs) {
+            for (int y = 0; y < g.rows; ++y) encodeCostRuns(costs + (size_t)y * g.cols, g.cols, out);
+        }
+    }
+    putLE(out, crc32(out.data(), out.size()), 4);
+}
+
+// Write to a temporary file, sync it, then rename it over the target: a crash mid-save leaves
+// either the old layout or the new one, never a torn file
+bool writeFileAtomic(const std::string& filename, const std::vector<unsigned char>& data) {
+    std::string temp = filename + ".tmp";
+    FILE* file = std::fopen(temp.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size() && std::fflush(file) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(file)) == 0;
+#else
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::remove(temp.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    return MoveFileExA(temp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (std::rename(temp.c_str(), filename.c_str()) != 0) return false;
+    // Sync the directory too so the rename itself survives a power loss
+    size_t slash = filename.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+    int dirFd = open(dir.c_str(), O_RDONLY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
+#endif
+}
+
+// Returns whether the grid changed now; LAYOUT_FILE is loaded on the writer and lands later
+bool loadLayout(const std::string& filename) {
+    if (inputReplay.active) return false; // The log carries the layout that was loaded here
+
+    // Only the default save file is journaled; edits to other layouts stay in memory until saved
+    detachJournal();
+    if (filename == LAYOUT_FILE) {
+        if (journaledLoad.queued) return false;
+        journaledLoad.queued = true;
+        SaveJob job(LAYOUT_FILE);
+        job.loadJournaled = true;
+        LayoutSaver& saver = layoutSaver;
+        {
+            std::lock_guard<std::mutex> lock(saver.mutex);
+            saver.jobs.push_back(std::move(job));
+            saver.stopping = false;
+            if (!saver.writer.joinable()) saver.writer = std::thread(layoutSaverLoop);
+        }
+        saver.changed.notify_all();
+        return false;
+    }
+
+    Grid loaded(0, 0);
+    if (!readLayoutFile(filename, loaded)) return false;
+    applyLayout(loaded);
+    recordLayout(true);
     std::cout << "Layout loaded from " << filename << std::endl;
+    return true;
+}
+
+// On the writer: the base and journal are read and the journal rewritten here, off the event loop
+void loadJournaledLayout() {
+    TraceScope trace("load layout");
+    Grid loaded(0, 0);
+    size_t records = 0;
+    FILE* journal = nullptr;
+    bool ok = readLayoutFile(LAYOUT_FILE, loaded);
+    if (ok) journal = openJournal(loaded, records);
+    {
+        std::lock_guard<std::mutex> lock(layoutSaver.mutex);
+        JournaledLoad& load = journaledLoad;
+        load.ready = true;
+        load.ok = ok;
+        load.grid = std::move(loaded);
+        load.journal = journal;
+        load.records = records;
+    }
+    SDL_Event done = {};
+    done.type = SDL_USEREVENT;
+    SDL_PushEvent(&done);
+}
+
+// Called by the event loop: swaps in the layout and starts journaling edits to it
+bool applyJournaledLoad() {
+    JournaledLoad& load = journaledLoad;
+    Grid loaded(0, 0);
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lock(layoutSaver.mutex);
+        if (!load.ready) return false;
+        load.ready = false;
+        ok = load.ok;
+        loaded = std::move(load.grid);
+        load.grid = Grid(0, 0);
+    }
+    load.queued = false;
+    if (ok) {
+        applyLayout(loaded);
+        {
+            std::lock_guard<std::mutex> lock(layoutJournal.mutex);
+            layoutJournal.file = load.journal;
+            layoutJournal.records = load.records;
+        }
+        recordLayout(true); // After the journal replay, so the log holds the grid the session plans on
+        std::cout << "Layout loaded from " << LAYOUT_FILE << std::endl;
+    }
+    if (load.saveAfter) {
+        load.saveAfter = false;
+        saveLayoutAsync(LAYOUT_FILE);
+    }
+    return ok;
+}
+
+// Any layout the loader reads, rewritten in the format the output extension picks. This is how
+// byte-per-cell .grid files are made; S only writes the binary save and the text export.
+bool convertLayout(const std::string& from, const std::string& to) {
+    Grid grid(0, 0);
+    if (!readLayoutFile(from, grid)) return false;
+    std::vector<unsigned char> out;
+    encodeLayout(grid, to, out);
+    if (!writeFileAtomic(to, out)) {
+        std::cerr << "Error saving layout to " << to << std::endl;
+        return false;
+    }
+    std::cout << "Converted " << from << " (" << grid.rows << "x" << grid.cols << ") to " << to << std::endl;
+    return true;
+}
+
+bool readLayoutFile(const std::string& filename, Grid& out) {
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    if (!ifs) {
+        std::cerr << "Error loading layout from file!" << std::endl;
+        return false;
+    }
+    size_t size = (size_t)ifs.tellg();
+    ifs.seekg(0);
+
+    // Byte-per-cell layouts are mapped rather than read, so startup cost doesn't grow with the map.
+    // Not the watched file, though: an editor rewriting it in place would change the mapped pages
+    // under the planner, and truncating it would fault them.
+    unsigned char head[LAYOUT_HEADER_BYTES];
+    LayoutHeader header;
+    if (filename != layoutWatcher.path && size >= sizeof(head) && ifs.read((char*)head, sizeof(head)) &&
+        std::equal(LAYOUT_MAGIC, LAYOUT_MAGIC + 4, head) &&
+        parseLayoutHeader(head, sizeof(head), header) && header.encoding == LAYOUT_ENCODING_BYTES) {
+        ifs.close();
+        if (mapLayoutFile(filename, out)) return true;
+        ifs.open(filename, std::ios::binary); // Mapping unavailable: fall back to reading
+    }
+
+    // Whole file in a single read, then detect the format from its first bytes
+    ifs.clear();
+    ifs.seekg(0);
+    std::vector<unsigned char> data(size);
+    ifs.read((char*)data.data(), (std::streamsize)data.size());
+    ifs.close();
+
+    if (data.size() >= 4 && std::equal(LAYOUT_MAGIC, LAYOUT_MAGIC + 4, data.begin())) {
+        return parseLayoutBinary(data, out);
+    }
+    const char* movingAiTag = "type ";
+    if (data.size() >= 5 && std::equal(movingAiTag, movingAiTag + 5, data.begin())) {
+        return parseMovingAiMap(data, out);
+    }
+    if (data.size() >= 2 && ((data[0] == 'B' && data[1] == 'M') || (data[0] == 'P' && data[1] == '5'))) {
+        return parseLayoutImage(data, out);
+    }
+    return parseLayoutText(data, out);
+}
+
+bool parseLayoutHeader(const unsigned char* p, size_t size, LayoutHeader& header) {
+    if (size < (size_t)LAYOUT_HEADER_BYTES) {
+        std::cerr << "Error loading layout: truncated header!" << std::endl;
+        return false;
+    }
+    header.version = (int)getLE(p + 4, 2);
+    header.encoding = p[6];
+    header.layers = p[7];
+    header.rows = getLE(p + 8, 4);
+    header.cols = getLE(p + 12, 4);
+    if (header.version != LAYOUT_VERSION || !(header.layers & LAYOUT_LAYER_OCCUPANCY) ||
+        (header.encoding != LAYOUT_ENCODING_BITS && header.encoding != LAYOUT_ENCODING_BYTES &&
+         header.encoding != LAYOUT_ENCODING_RUNS)) {
+        std::cerr << "Error loading layout: unsupported version " << header.version << ", encoding "
+                  << header.encoding << ", layers " << header.layers << std::endl;
+        return false;
+    }
+    if (header.rows == 0 || header.cols == 0 || header.rows > (Uint32)INT_MAX || header.cols > (Uint32)INT_MAX) {
+        std::cerr << "Error loading layout: bad dimensions " << header.rows << "x" << header.cols << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Exact file size for the fixed-size encodings; a lower bound for the run encoding
+size_t layoutFileSize(const LayoutHeader& header) {
+    if (header.encoding == LAYOUT_ENCODING_RUNS) return LAYOUT_HEADER_BYTES + header.rows + 4;
+    size_t cells = (size_t)header.rows * header.cols;
+    size_t occupancy = header.encoding == LAYOUT_ENCODING_BITS ? (cells + 7) / 8 : cells;
+    return LAYOUT_HEADER_BYTES + occupancy + ((header.layers & LAYOUT_LAYER_COST) ? cells : 0) + 4;
+}
+
+bool parseLayoutBinary(const std::vector<unsigned char>& data, Grid& out) {
+    LayoutHeader header;
+    if (!parseLayoutHeader(data.data(), data.size(), header)) return false;
+
+    size_t expected = layoutFileSize(header);
+    bool runs = header.encoding == LAYOUT_ENCODING_RUNS;
+    if (runs ? data.size() < expected : data.size() != expected) {
+        std::cerr << "Error loading layout: expected " << expected << " bytes, found " << data.size() << std::endl;
+        return false;
+    }
+    const unsigned char* p = data.data();
+    if (crc32(p, data.size() - 4) != getLE(p + data.size() - 4, 4)) {
+        std::cerr << "Error loading layout: checksum mismatch!" << std::endl;
+        return false;
+    }
+
+    size_t cells = (size_t)header.rows * header.cols;
+    const unsigned char* payload = p + LAYOUT_HEADER_BYTES;
+    out.rows = (int)header.rows;
+    out.cols = (int)header.cols;
+    out.mapping.reset();
+    if (runs) {
+        const unsigned char* end = p + data.size() - 4;
+        size_t cols = header.cols;
+        out.cells.resize(cells);
+        bool ok = true;
+        for (size_t y = 0; ok && y < header.rows; ++y) ok = decodeRuns(payload, end, &out.cells[y * cols], cols);
+        if (header.layers & LAYOUT_LAYER_COST) {
+            out.costs.resize(cells);
+            for (size_t y = 0; ok && y < header.rows; ++y) ok = decodeCostRuns(payload, end, &out.costs[y * cols], cols);
+        } else {
+            out.costs.clear();
+        }
+        if (!ok || payload != end) {
+            std::cerr << "Error loading layout: malformed run data!" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if (header.encoding == LAYOUT_ENCODING_BYTES) {
+        out.cells.assign(payload, payload + cells);
+        payload += cells;
+    } else {
+        out.cells.resize(cells);
+        for (size_t i = 0; i < cells; ++i) {
+            out.cells[i] = (payload[i / 8] >> (i % 8)) & 1;
+        }
+        payload += (cells + 7) / 8;
+    }
+    if (header.layers & LAYOUT_LAYER_COST) {
+        out.costs.assign(payload, payload + cells);
+    } else {
+        out.costs.clear();
+    }
+    return true;
+}
+
+// Runs never cross a row boundary, so a row of uniform rack or aisle costs one or two bytes
+void encodeRuns(const unsigned char* row, int cols, std::vector<unsigned char>& out) {
+    unsigned char value = 0;
+    for (int x = 0; x < cols;) {
+        int start = x;
+        while (x < cols && (row[x] != 0) == (value != 0)) ++x;
+        putVarint(out, (Uint32)(x - start));
+        value ^= 1;
+    }
+}
+
+void encodeCostRuns(const unsigned char* row, int cols, std::vector<unsigned char>& out) {
+    for (int x = 0; x < cols;) {
+        int start = x;
+        while (x < cols && row[x] == row[start]) ++x;
+        out.push_back(row[start]);
+        putVarint(out, (Uint32)(x - start));
+    }
+}
+
+// Decodes one row; each run is a single memset straight into the grid
+bool decodeRuns(const unsigned char*& p, const unsigned char* end, unsigned char* cells, size_t count) {
+    unsigned char value = 0;
+    size_t filled = 0;
+    while (filled < count) {
+        Uint32 length;
+        if (!getVarint(p, end, length) || length > count - filled) return false;
+        memset(cells + filled, value, length);
+        filled += length;
+        value ^= 1;
+    }
+    return true;
+}
+
+bool decodeCostRuns(const unsigned char*& p, const unsigned char* end, unsigned char* costs, size_t count) {
+    size_t filled = 0;
+    while (filled < count) {
+        Uint32 length;
+        if (p == end) return false;
+        unsigned char value = *p++;
+        if (!getVarint(p, end, length) || length == 0 || length > count - filled) return false;
+        memset(costs + filled, value, length);
+        filled += length;
+    }
+    return true;
+}
+
+void putVarint(std::vector<unsigned char>& out, Uint32 value) {
+    while (value >= 0x80) {
+        out.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+
+bool getVarint(const unsigned char*& p, const unsigned char* end, Uint32& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (Uint32)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool mapLayoutFile(const std::string& filename, Grid& out) {
+    std::shared_ptr<MappedFile> file = mapFile(filename);
+    if (!file) return false;
+
+    // The header and size are checked, but not the CRC: that would touch every page up front.
+    // Use the copying loader (or re-save) when a file's integrity is in doubt.
+    LayoutHeader header;
+    if (!parseLayoutHeader(file->base, file->size, header)) return false;
+    if (file->size != layoutFileSize(header)) {
+        std::cerr << "Error loading layout: expected " << layoutFileSize(header) << " bytes, found "
+                  << file->size << std::endl;
+        return false;
+    }
+
+    size_t cells = (size_t)header.rows * header.cols;
+    out.rows = (int)header.rows;
+    out.cols = (int)header.cols;
+    out.cells.clear();
+    out.costs.clear();
+    out.mappedCells = file->base + LAYOUT_HEADER_BYTES;
+    out.mappedCosts = (header.layers & LAYOUT_LAYER_COST) ? out.mappedCells + cells : nullptr;
+    out.mapping = file;
+    return true;
+}
+
+std::shared_ptr<MappedFile> mapFile(const std::string& filename) {
+    auto file = std::make_shared<MappedFile>();
+#ifdef _WIN32
+    file->file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file->file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file->file, &size) || size.QuadPart == 0) return nullptr;
+    file->size = (size_t)size.QuadPart;
+    file->mapping = CreateFileMappingA(file->file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (!file->mapping) return nullptr;
+    file->base = (unsigned char*)MapViewOfFile(file->mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (!file->base) return nullptr;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    file->size = (size_t)st.st_size;
+    void* base = mmap(nullptr, file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (base == MAP_FAILED) return nullptr;
+    file->base = (unsigned char*)base;
+#endif
+    return file;
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+    if (base) munmap(base, size);
+#endif
+}
+
+bool parseLayoutText(std::vector<unsigned char>& data, Grid& out) {
+    // One text line per row; the map size is taken from the file
+    data.push_back('\0'); // Lets strtol run off the end of the buffer safely
+    std::vector<unsigned char> cells;
+    int rows = 0, cols = 0;
+    const char* p = (const char*)data.data();
+    while (*p) {
+        int count = 0;
+        char* end = nullptr;
+        for (;;) {
+            while (*p == ' ' || *p == '\t' || *p == '\r') ++p;
+            if (*p == '\n' || *p == '\0') break;
+            long value = std::strtol(p, &end, 10);
+            if (end == p) {
+                std::cerr << "Error loading layout: unexpected character in row " << rows << std::endl;
+                return false;
+            }
+            cells.push_back(value != 0 ? 1 : 0);
+            ++count;
+            p = end;
+        }
+        if (*p == '\n') ++p;
+        if (count == 0) continue;
+        if (cols == 0) cols = count;
+        if (count != cols) {
+            std::cerr << "Error loading layout: row " << rows << " has " << count
+                      << " cells, expected " << cols << std::endl;
+            return false;
+        }
+        ++rows;
+    }
+    if (rows == 0) {
+        std::cerr << "Error loading layout: file is empty!" << std::endl;
+        return false;
+    }
+
+    out.rows = rows;
+    out.cols = cols;
+    out.mapping.reset();
+    out.cells.swap(cells);
+    out.costs.clear();
+    return true;
+}
+
+void applyLayout(Grid& loaded) {
+    bool resized = loaded.rows != warehouseGrid.rows || loaded.cols != warehouseGrid.cols;
+    std::swap(warehouseGrid, loaded);
+    markGridDirty();
+
+    // Keep the robot and destination on the map if its size changed
+    if (!isInsideGrid(robot.gridPos.x, robot.gridPos.y)) robot = Robot(0, 0);
+    if (!isInsideGrid(destination.x, destination.y)) hasDestination = false;
+    if (resized) fitCameraToMap(); // Traffic counters are reallocated on the next record
+}
+
+// MovingAI octile map: a "type/height/width/map" header, then one character per cell.
+// '.', 'G' and 'S' (swamp) are passable; '@', 'O', 'T' (trees) and 'W' (water) are obstacles.
+bool parseMovingAiMap(const std::vector<unsigned char>& data, Grid& out) {
+    std::istringstream in(std::string(data.begin(), data.end()));
+    std::string key, type;
+    int height = 0, width = 0;
+    while (in >> key && key != "map") {
+        if (key == "type") in >> type;
+        else if (key == "height") in >> height;
+        else if (key == "width") in >> width;
+    }
+    if (key != "map" || height <= 0 || width <= 0) {
+        std::cerr << "Error loading MovingAI map: bad header!" << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> cells((size_t)height * width);
+    std::string line;
+    std::getline(in, line); // Rest of the "map" line
+    for (int y = 0; y < height; ++y) {
+        if (!std::getline(in, line) || (int)line.size() < width) {
+            std::cerr << "Error loading MovingAI map: row " << y << " is short or missing" << std::endl;
+            return false;
+        }
+        for (int x = 0; x < width; ++x) {
+            char c = line[x];
+            cells[(size_t)y * width + x] = (c == '.' || c == 'G' || c == 'S') ? 0 : 1;
+        }
+    }
+
+    out.rows = height;
+    out.cols = width;
+    out.mapping.reset();
+    out.cells.swap(cells);
+    out.costs.clear();
+    return true;
+}
+
+// Runs every scenario with both planners and prints per-bucket timing and expansions.
+// The reference optimum is for octile moves without corner cutting; our planners are 4-connected,
+// so a correct path has the same reachability and a length between the optimum and sqrt(2) times it.
+bool runScenarios(const std::string& filename) {
+    std::ifstream ifs(filename);
+    std::string line;
+    if (!ifs || !std::getline(ifs, line) || line.compare(0, 7, "version") != 0) {
+        std::cerr << "Error loading scenarios from " << filename << std::endl;
+        return false;
+    }
+    std::string dir = filename.substr(0, filename.find_last_of("/\\") + 1);
+
+    useCongestionCost = false;
+    std::vector<ScenarioBucket> buckets;
+    std::string loadedMap;
+    int failures = 0;
+    const Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    while (std::getline(ifs, line)) {
+        std::istringstream fields(line);
+        int bucket, width, height;
+        Point start, goal;
+        double optimal;
+        std::string mapName;
+        if (!(fields >> bucket >> mapName >> width >> height >> start.x >> start.y >> goal.x >> goal.y >> optimal)) continue;
+
+        if (mapName != loadedMap) {
+            // Map paths are usually relative to the scenario file
+            Grid loaded(0, 0);
+            std::ifstream probe(dir + mapName);
+            if (!readLayoutFile(probe ? dir + mapName : mapName, loaded)) return false;
+            warehouseGrid = std::move(loaded);
+            loadedMap = mapName;
+        }
+        if (width != warehouseGrid.cols || height != warehouseGrid.rows) {
+            std::cerr << "Scenario map " << mapName << " is " << warehouseGrid.cols << "x" << warehouseGrid.rows
+                      << ", expected " << width << "x" << height << std::endl;
+            return false;
+        }
+
+        if (bucket < 0) continue;
+        if ((int)buckets.size() <= bucket) buckets.resize(bucket + 1);
+        ScenarioBucket& b = buckets[bucket];
+        ++b.scenarios;
+
+        size_t lengths[2];
+        bool ok = true;
+        for (int algorithm = 0; algorithm < 2; ++algorithm) {
+            SearchStatsTracer tracer;
+            Uint64 begin = SDL_GetPerformanceCounter();
+            std::vector<Point> path = algorithm ? aStarSearch(start, goal, tracer) : bfsSearch(start, goal, tracer);
+            b.seconds[algorithm] += (double)(SDL_GetPerformanceCounter() - begin) / frequency;
+            recordLatency(algorithm ? LATENCY_BATCH_ASTAR : LATENCY_BATCH_BFS, begin);
+            b.expanded[algorithm] += (double)tracer.stats.expanded;
+            lengths[algorithm] = path.size();
+            ok = ok && checkScenarioPath(path, start, goal);
+        }
+
+        double length = (double)lengths[0];
+        const double tolerance = 1e-3;
+        ok = ok && lengths[0] == lengths[1] && length + tolerance >= optimal &&
+             length <= optimal * std::sqrt(2.0) + tolerance;
+        b.lengthRatio += optimal > 0 ? length / optimal : 1.0;
+        if (!ok) {
+            ++b.failures;
+            ++failures;
+            std::cerr << "Scenario failed: bucket " << bucket << " " << start.x << "," << start.y << " -> "
+                      << goal.x << "," << goal.y << " optimal " << optimal << ", BFS " << lengths[0]
+                      << ", A* " << lengths[1] << std::endl;
+        }
+    }
+
+    std::printf("%-6s %6s %12s %12s %12s %12s %9s %8s\n", "bucket", "count", "bfs_us", "bfs_exp",
+                "astar_us", "astar_exp", "len/opt", "failed");
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        const ScenarioBucket& b = buckets[i];
+        if (b.scenarios == 0) continue;
+        double n = b.scenarios;
+        std::printf("%-6zu %6d %12.1f %12.1f %12.1f %12.1f %9.3f %8d\n", i, b.scenarios, b.seconds[0] / n * 1e6,
+                    b.expanded[0] / n, b.seconds[1] / n * 1e6, b.expanded[1] / n, b.lengthRatio / n, b.failures);
+    }
+    dumpLatencyHistograms(LATENCY_FILE);
+    return failures == 0;
+}
+
+// A valid answer starts next to the start, steps between adjacent free cells and ends on the goal
+bool checkScenarioPath(const std::vector<Point>& path, Point start, Point goal) {
+    if (start == goal) return path.empty();
+    if (path.empty() || !(path.back() == goal)) return false;
+    Point previous = start;
+    for (const Point& p : path) {
+        if (!isValidGridPosition(p.x, p.y) || std::abs(p.x - previous.x) + std::abs(p.y - previous.y) != 1) return false;
+        previous = p;
+    }
+    return true;
+}
+
+bool parseLayoutImage(const std::vector<unsigned char>& data, Grid& out) {
+    // Binary PGM: the pixels are already one gray byte each, so threshold straight from the file buffer
+    if (data[0] == 'P') {
+        int width, height, maxValue;
+        size_t offset;
+        if (!parsePgmHeader(data, width, height, maxValue, offset) || data.size() - offset < (size_t)width * height) {
+            std::cerr << "Error loading layout: unsupported or truncated PGM image!" << std::endl;
+            return false;
+        }
+        unsigned char scale[256];
+        for (int i = 0; i < 256; ++i) scale[i] = (unsigned char)(std::min(i, maxValue) * 255 / maxValue);
+        ImageView image = {data.data() + offset, width, height, width, 1, maxValue == 255 ? nullptr : scale, 0, 0, 0};
+        thresholdImage(image, out);
+        return true;
+    }
+
+    SDL_Surface* surface = SDL_LoadBMP_RW(SDL_RWFromConstMem(data.data(), (int)data.size()), 1);
+    if (!surface) {
+        std::cerr << "Error loading layout image: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    // 8-bit paletted and 24/32-bit images are read in place; anything else is converted first
+    int bytesPerPixel = surface->format->BytesPerPixel;
+    if (!(bytesPerPixel == 1 && surface->format->palette) && bytesPerPixel != 3 && bytesPerPixel != 4) {
+        SDL_Surface* converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(surface);
+        if (!converted) {
+            std::cerr << "Error converting layout image: " << SDL_GetError() << std::endl;
+            return false;
+        }
+        surface = converted;
+        bytesPerPixel = 4;
+    }
+
+    unsigned char paletteGray[256] = {0};
+    if (SDL_Palette* palette = surface->format->palette) {
+        for (int i = 0; i < palette->ncolors && i < 256; ++i) {
+            const SDL_Color& c = palette->colors[i];
+            paletteGray[i] = (unsigned char)((c.r * 77 + c.g * 150 + c.b * 29) >> 8);
+        }
+    }
+    SDL_LockSurface(surface);
+    ImageView image = {(const unsigned char*)surface->pixels, surface->w, surface->h, surface->pitch, bytesPerPixel,
+                       paletteGray, surface->format->Rshift, surface->format->Gshift, surface->format->Bshift};
+    thresholdImage(image, out);
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+    return true;
+}
+
+// "P5 <width> <height> <maxval>" with optional '#' comments, then a single whitespace byte before the pixels
+bool parsePgmHeader(const std::vector<unsigned char>& data, int& width, int& height, int& maxValue, size_t& offset) {
+    int values[3];
+    offset = 2;
+    for (int& value : values) {
+        while (offset < data.size() && (std::isspace(data[offset]) || data[offset] == '#')) {
+            if (data[offset] == '#') {
+                while (offset < data.size() && data[offset] != '\n') ++offset;
+            } else {
+                ++offset;
+            }
+        }
+        if (offset >= data.size() || !std::isdigit(data[offset])) return false;
+        value = 0;
+        while (offset < data.size() && std::isdigit(data[offset]) && value < 1000000) value = value * 10 + (data[offset++] - '0');
+    }
+    ++offset;
+    width = values[0];
+    height = values[1];
+    maxValue = values[2];
+    return width > 0 && height > 0 && maxValue > 0 && maxValue < 256 && offset <= data.size();
+}
+
+// Splits the cell rows into one band per hardware thread; bands write disjoint rows of the grid
+void thresholdImage(const ImageView& image, Grid& out) {
+    int cellSize = imageImport.cellSize;
+    out.rows = (image.height + cellSize - 1) / cellSize;
+    out.cols = (image.width + cellSize - 1) / cellSize;
+    out.mapping.reset();
+    out.cells.assign((size_t)out.rows * out.cols, 0);
+    if (imageImport.grayCosts)
+        out.costs.assign(out.cells.size(), 0);
+    else
+        out.costs.clear();
+
+    int bands = std::max(1, std::min((int)std::thread::hardware_concurrency(), out.rows));
+    std::vector<std::thread> workers;
+    for (int band = 1; band < bands; ++band) {
+        workers.emplace_back(thresholdImageRows, std::cref(image), out.rows * band / bands,
+                             out.rows * (band + 1) / bands, std::ref(out));
+    }
+    thresholdImageRows(image, 0, out.rows / bands, out);
+    for (auto& worker : workers) worker.join();
+}
+
+void thresholdImageRows(const ImageView& image, int y0, int y1, Grid& out) {
+    TraceScope trace("threshold rows");
+    int cellSize = imageImport.cellSize;
+    std::vector<unsigned int> sums(out.cols);
+    for (int cy = y0; cy < y1; ++cy) {
+        // Sum each block row by row so the image is read sequentially
+        std::fill(sums.begin(), sums.end(), 0);
+        int py1 = std::min(image.height, (cy + 1) * cellSize);
+        for (int py = cy * cellSize; py < py1; ++py) {
+            const unsigned char* row = image.pixels + (size_t)py * image.pitch;
+            bool plainGray = image.bytesPerPixel == 1 && !image.grayLut;
+            for (int cx = 0, px0 = 0; cx < out.cols; ++cx, px0 += cellSize) {
+                int px1 = std::min(image.width, px0 + cellSize);
+                unsigned int sum = 0;
+                if (plainGray) {
+                    for (int px = px0; px < px1; ++px) sum += row[px];
+                } else {
+                    for (int px = px0; px < px1; ++px) sum += image.gray(px, py);
+                }
+                sums[cx] += sum;
+            }
+        }
+        int blockHeight = py1 - cy * cellSize;
+        for (int cx = 0; cx < out.cols; ++cx) {
+            int blockWidth = std::min(image.width, (cx + 1) * cellSize) - cx * cellSize;
+            unsigned int area = (unsigned int)blockWidth * blockHeight;
+            int mean = (int)(area == 1 ? sums[cx] : sums[cx] / area);
+            size_t i = (size_t)cy * out.cols + cx;
+            out.cells[i] = mean < imageImport.threshold;
+            if (!out.costs.empty() && !out.cells[i]) out.costs[i] = (unsigned char)((255 - mean) / IMAGE_GRAY_PER_COST);
+        }
+    }
+}
+
+std::string journalPath() {
+    return LAYOUT_FILE + ".journal";
+}
+
+// Replays a matching journal onto the freshly read base and reopens it for appending
+FILE* openJournal(Grid& base, size_t& records) {
+    records = 0;
+    Uint32 baseCrc;
+    if (!readBaseCrc(baseCrc)) return nullptr;
+
+    std::vector<unsigned char> data;
+    {
+        std::ifstream ifs(journalPath(), std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    bool matches = data.size() >= (size_t)JOURNAL_HEADER_BYTES && std::equal(JOURNAL_MAGIC, JOURNAL_MAGIC + 4, data.begin()) &&
+                   (getLE(&data[4], 4) == baseCrc || getLE(&data[8], 4) == baseCrc);
+    if (!data.empty() && !matches) std::cerr << "Ignoring edit journal written for a different layout" << std::endl;
+
+    if (matches) {
+        for (size_t at = JOURNAL_HEADER_BYTES; at + JOURNAL_RECORD_BYTES <= data.size(); at += JOURNAL_RECORD_BYTES) {
+            const unsigned char* r = &data[at];
+            if (crc32(r, 12) != getLE(r + 12, 4)) break; // Torn write from a crash
+            Uint32 x = getLE(r, 4), y = getLE(r + 4, 4);
+            if (x < (Uint32)base.cols && y < (Uint32)base.rows) base[y][x] = r[8];
+            ++records;
+        }
+        if (records > 0) std::cout << "Replayed " << records << " journaled edits" << std::endl;
+    }
+
+    // Start over from just the header (and valid records) so a torn tail isn't appended after
+    std::vector<unsigned char> header(JOURNAL_MAGIC, JOURNAL_MAGIC + 4);
+    putLE(header, baseCrc, 4);
+    putLE(header, 0, 4);
+    header.insert(header.end(), data.begin() + std::min(data.size(), (size_t)JOURNAL_HEADER_BYTES),
+                  data.begin() + std::min(data.size(), JOURNAL_HEADER_BYTES + records * JOURNAL_RECORD_BYTES));
+    if (!matches) header.resize(JOURNAL_HEADER_BYTES);
+    FILE* file = writeFileAtomic(journalPath(), header) ? std::fopen(journalPath().c_str(), "ab") : nullptr;
+    if (!file) std::cerr << "Error opening edit journal " << journalPath() << std::endl;
+    return file;
+}
+
+void detachJournal() {
+    std::lock_guard<std::mutex> lock(layoutJournal.mutex);
+    if (layoutJournal.file) std::fclose(layoutJournal.file);
+    layoutJournal.file = nullptr;
+    layoutJournal.records = 0;
+    layoutJournal.trimmed = 0;
+    layoutJournal.starting = false; // A first save still in flight won't open the journal
+    layoutJournal.pending.clear();
+}
+
+// One 16-byte append per edit. Flushed to the OS, so it survives the app crashing; fsync is left
+// to compaction to keep clicks cheap.
+void journalEdit(int x, int y, int value) {
+    bool compact;
+    {
+        std::lock_guard<std::mutex> lock(layoutJournal.mutex);
+        if (!layoutJournal.file && !layoutJournal.starting) return;
+        std::vector<unsigned char> record;
+        putLE(record, (Uint32)x, 4);
+        putLE(record, (Uint32)y, 4);
+        putLE(record, (Uint32)value, 4);
+        putLE(record, crc32(record.data(), record.size()), 4);
+        if (layoutJournal.file) {
+            std::fwrite(record.data(), 1, record.size(), layoutJournal.file);
+            std::fflush(layoutJournal.file);
+        } else {
+            layoutJournal.pending.insert(layoutJournal.pending.end(), record.begin(), record.end());
+        }
+        ++layoutJournal.records;
+        compact = layoutJournal.file && layoutJournal.records >= JOURNAL_COMPACT_RECORDS && !layoutJournal.compacting;
+    }
+    if (compact) saveLayoutAsync(LAYOUT_FILE); // Writes the current grid as the new base, then trims
+}
+
+// On the writer, after the first save of LAYOUT_FILE: create the journal against the new base,
+// carrying over the edits made meanwhile. The file is written without holding the journal lock.
+void startJournal(bool baseWritten, Uint32 baseCrc) {
+    LayoutJournal& journal = layoutJournal;
+    std::vector<unsigned char> header(JOURNAL_MAGIC, JOURNAL_MAGIC + 4);
+    putLE(header, baseCrc, 4);
+    putLE(header, 0, 4);
+    {
+        std::lock_guard<std::mutex> lock(journal.mutex);
+        header.insert(header.end(), journal.pending.begin(), journal.pending.end());
+        journal.pending.clear();
+    }
+    bool ok = baseWritten && writeFileAtomic(journalPath(), header);
+
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    if (ok && journal.starting) journal.file = std::fopen(journalPath().c_str(), "ab");
+    if (journal.file && !journal.pending.empty()) {
+        std::fwrite(journal.pending.data(), 1, journal.pending.size(), journal.file);
+        std::fflush(journal.file);
+    }
+    if (!journal.file) {
+        if (journal.starting) std::cerr << "Error opening edit journal " << journalPath() << std::endl;
+        journal.records = 0;
+    }
+    journal.pending.clear();
+    journal.starting = false;
+}
+
+// Before the base is replaced: record the CRC it is about to have, so the journal still matches
+// whichever base a crash leaves behind
+bool setJournalNextCrc(Uint32 crc) {
+    std::lock_guard<std::mutex> lock(layoutJournal.mutex);
+    FILE* file = std::fopen(journalPath().c_str(), "r+b");
+    if (!file) return false;
+    std::vector<unsigned char> bytes;
+    putLE(bytes, crc, 4);
+    bool ok = std::fseek(file, 8, SEEK_SET) == 0 && std::fwrite(bytes.data(), 1, 4, file) == 4 && std::fflush(file) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(file)) == 0;
+#else
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    return std::fclose(file) == 0 && ok;
+}
+
+// After the base is replaced: drop the records it now contains and keep the rest
+bool trimJournal(size_t records, Uint32 baseCrc) {
+    std::lock_guard<std::mutex> lock(layoutJournal.mutex);
+    if (!layoutJournal.file) return false;
+    std::vector<unsigned char> data;
+    {
+        std::ifstream ifs(journalPath(), std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    size_t drop = records - layoutJournal.trimmed;
+    size_t keepFrom = std::min(data.size(), JOURNAL_HEADER_BYTES + drop * JOURNAL_RECORD_BYTES);
+    std::vector<unsigned char> trimmed(JOURNAL_MAGIC, JOURNAL_MAGIC + 4);
+    putLE(trimmed, baseCrc, 4);
+    putLE(trimmed, 0, 4);
+    trimmed.insert(trimmed.end(), data.begin() + keepFrom, data.end());
+
+    std::fclose(layoutJournal.file);
+    bool ok = writeFileAtomic(journalPath(), trimmed);
+    layoutJournal.file = std::fopen(journalPath().c_str(), "ab");
+    layoutJournal.records = (trimmed.size() - JOURNAL_HEADER_BYTES) / JOURNAL_RECORD_BYTES;
+    layoutJournal.trimmed = records;
+    return ok;
+}
+
+// Binary layouts end in the CRC-32 of everything before it, which identifies the base cheaply
+bool readBaseCrc(Uint32& crc) {
+    std::ifstream ifs(LAYOUT_FILE, std::ios::binary | std::ios::ate);
+    if (!ifs || ifs.tellg() < (std::streamoff)(LAYOUT_HEADER_BYTES + 4)) return false;
+    unsigned char bytes[4];
+    ifs.seekg(-4, std::ios::end);
+    if (!ifs.read((char*)bytes, 4)) return false;
+    crc = getLE(bytes, 4);
+    return true;
+}
+
+bool startLayoutWatcher(const std::string& path) {
+    LayoutWatcher& watcher = layoutWatcher;
+    watcher.path = path;
+    watcher.stopping = false;
+    watcher.thread = std::thread(layoutWatcherLoop);
+    std::cout << "Watching " << path << " for changes" << std::endl;
+    return true;
+}
+
+void stopLayoutWatcher() {
+    {
+        std::lock_guard<std::mutex> lock(layoutWatcher.mutex);
+        layoutWatcher.stopping = true;
+    }
+    layoutWatcher.snapshotTaken.notify_all();
+    if (layoutWatcher.thread.joinable()) layoutWatcher.thread.join();
+#ifdef __linux__
+    if (layoutWatcher.notifyFd >= 0) close(layoutWatcher.notifyFd);
+    layoutWatcher.notifyFd = -1;
+#endif
+}
+
+void layoutWatcherLoop() {
+    traceThreadName = "layout watcher";
+    while (!layoutWatcher.stopping) {
+        if (!waitForLayoutChange()) continue;
+        std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_SETTLE_MS));
+        reloadWatchedLayout();
+    }
+}
+
+#ifdef __linux__
+// Watches the directory rather than the file, so replacing it by rename is seen too
+bool waitForLayoutChange() {
+    int& fd = layoutWatcher.notifyFd;
+    if (fd < 0) {
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        size_t slash = layoutWatcher.path.find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : layoutWatcher.path.substr(0, slash + 1);
+        if (fd < 0 || inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            std::cerr << "Error watching " << dir << " for layout changes" << std::endl;
+            if (fd >= 0) close(fd);
+            fd = -1;
+            layoutWatcher.stopping = true;
+            return false;
+        }
+    }
+
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, WATCH_POLL_MS) <= 0) return false;
+    std::string name = layoutWatcher.path.substr(layoutWatcher.path.find_last_of('/') + 1);
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length;) {
+            const inotify_event* ev = (const inotify_event*)p;
+            if (ev->len > 0 && name == ev->name) changed = true;
+            p += sizeof(inotify_event) + ev->len;
+        }
+    }
+    return changed;
+}
+#else
+// Without inotify, poll the modification time and size
+bool waitForLayoutChange() {
+    time_t& lastTime = layoutWatcher.lastTime;
+    long long& lastSize = layoutWatcher.lastSize;
+    std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_POLL_MS));
+    struct stat st;
+    if (stat(layoutWatcher.path.c_str(), &st) != 0) return false;
+    bool changed = lastSize >= 0 && (st.st_mtime != lastTime || (long long)st.st_size != lastSize);
+    lastTime = st.st_mtime;
+    lastSize = st.st_size;
+    return changed;
+}
+#endif
+
+void reloadWatchedLayout() {
+    TraceScope trace("reload layout");
+    LayoutWatcher& watcher = layoutWatcher;
+    Grid loaded(0, 0);
+    if (!readLayoutFile(watcher.path, loaded)) return; // Half-written file: the next change retries
+
+    // Diff against what is on screen now: the grid may have been replaced by L or edited by hand
+    // since the file last changed, and the watched file may never have been loaded at all
+    SDL_Event wake = {};
+    wake.type = SDL_USEREVENT;
+    Grid last(0, 0);
+    {
+        std::unique_lock<std::mutex> lock(watcher.mutex);
+        watcher.snapshotRequested = true;
+        SDL_PushEvent(&wake);
+        watcher.snapshotTaken.wait(lock, [&] { return watcher.stopping || !watcher.snapshotRequested; });
+        if (watcher.snapshotRequested) return; // Shutting down
+        last = std::move(watcher.snapshot);
+        watcher.snapshot = Grid(0, 0);
+    }
+
+    LayoutReload reload;
+    reload.resized = loaded.rows != last.rows || loaded.cols != last.cols;
+    if (!reload.resized) {
+        const unsigned char* before = last.data();
+        const unsigned char* after = loaded.data();
+        size_t cells = (size_t)loaded.rows * loaded.cols;
+        for (size_t i = 0; i < cells; ++i) {
+            if (before[i] != after[i]) reload.edits.push_back({{(int)(i % loaded.cols), (int)(i / loaded.cols)}, after[i]});
+        }
+        const unsigned char* costsBefore = last.costData();
+        const unsigned char* costsAfter = loaded.costData();
+        reload.costsChanged = (costsBefore == nullptr) != (costsAfter == nullptr) ||
+                              (costsAfter && std::memcmp(costsBefore, costsAfter, cells) != 0);
+        if (reload.edits.empty() && !reload.costsChanged) return;
+    }
+    reload.grid = std::move(loaded);
+
+    // The event loop applies a pending reload before it serves the next snapshot, so at most one
+    // is ever queued
+    {
+        std::lock_guard<std::mutex> lock(watcher.mutex);
+        watcher.reload = std::move(reload);
+        watcher.ready = true;
+    }
+    SDL_PushEvent(&wake);
+}
+
+// Called by the event loop: copies the grid for the watcher to diff against. Two memcpys, like
+// the save snapshot; the diff itself stays on the watcher thread.
+void serveLayoutSnapshot() {
+    LayoutWatcher& watcher = layoutWatcher;
+    {
+        std::lock_guard<std::mutex> lock(watcher.mutex);
+        if (!watcher.snapshotRequested) return;
+        const Grid& g = warehouseGrid;
+        size_t cells = (size_t)g.rows * g.cols;
+        Grid& snapshot = watcher.snapshot;
+        snapshot.rows = g.rows;
+        snapshot.cols = g.cols;
+        snapshot.cells.assign(g.data(), g.data() + cells);
+        if (const unsigned char* costs = g.costData())
+            snapshot.costs.assign(costs, costs + cells);
+        else
+            snapshot.costs.clear();
+        watcher.snapshotRequested = false;
+    }
+    watcher.snapshotTaken.notify_all();
+}
+
+// Called by the event loop. Same-size changes go through setCell, so the static layer, cell
+// textures and occupancy pyramid patch just those cells instead of rebuilding.
+bool applyLayoutReload(const std::vector<Point>& path, size_t from, bool& replan) {
+    LayoutReload reload;
+    {
+        std::lock_guard<std::mutex> lock(layoutWatcher.mutex);
+        if (!layoutWatcher.ready) return false;
+        reload = std::move(layoutWatcher.reload);
+        layoutWatcher.ready = false;
+    }
+
+    Grid& grid = reload.grid;
+    if (reload.resized || grid.rows != warehouseGrid.rows || grid.cols != warehouseGrid.cols) {
+        applyLayout(grid);
+        detachJournal(); // A different map now: later edits must not replay onto the saved one
+        replan = true;
+        std::cout << "Layout reloaded from " << layoutWatcher.path << std::endl;
+        return true;
+    }
+
+    // Journal the reloaded cells like clicks, so the saved layout plus its journal still matches the
+    // grid after a crash. The journal has no cost records, so a cost change detaches it instead.
+    for (const CellEdit& edit : reload.edits) {
+        setCell(edit.cell.x, edit.cell.y, edit.value);
+        journalEdit(edit.cell.x, edit.cell.y, edit.value);
+    }
+    if (reload.costsChanged) {
+        detachJournal();
+        const unsigned char* costs = grid.costData();
+        if (costs)
+            warehouseGrid.costs.assign(costs, costs + (size_t)grid.rows * grid.cols);
+        else
+            warehouseGrid.costs.clear();
+        if (warehouseGrid.mapping) warehouseGrid.mappedCosts = costs ? warehouseGrid.costs.data() : nullptr;
+    }
+
+    // Replan when the remaining route is blocked, when costs moved, or when we had no route at all
+    replan = reload.costsChanged || path.empty();
+    for (size_t i = from; i < path.size() && !replan; ++i) replan = !isValidGridPosition(path[i].x, path[i].y);
+    std::cout << "Layout reloaded from " << layoutWatcher.path << ": " << reload.edits.size() << " cells changed"
+              << std::endl;
+    return true;
+}
+
+bool startRecording(const std::string& filename) {
+    InputRecorder& rec = inputRecorder;
+    rec.stream.open(filename, std::ios::binary);
+    if (!rec.stream) {
+        std::cerr << "Error opening input log " << filename << std::endl;
+        return false;
+    }
+    std::vector<unsigned char> header(INPUT_LOG_MAGIC, INPUT_LOG_MAGIC + 4);
+    putLE(header, INPUT_LOG_VERSION, 2);
+    rec.stream.write((const char*)header.data(), (std::streamsize)header.size());
+    rec.lastTick = simTick;
+    rec.active = true;
+    // The starting layout, so the replay doesn't depend on whatever map the files hold later
+    recordLayout(false);
+    return true;
+}
+
+void stopRecording() {
+    if (!inputRecorder.active) return;
+    inputRecorder.stream.close();
+    inputRecorder.active = false;
+}
+
+bool startReplay(const std::string& filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if (data.size() < 6 || !std::equal(INPUT_LOG_MAGIC, INPUT_LOG_MAGIC + 4, data.begin()) ||
+        (int)getLE(&data[4], 2) != INPUT_LOG_VERSION) {
+        std::cerr << "Error loading input log " << filename << std::endl;
+        return false;
+    }
+
+    InputReplay& replay = inputReplay;
+    const unsigned char* p = data.data() + 6;
+    const unsigned char* end = data.data() + data.size();
+    unsigned long long tick = simTick;
+    while (p < end) {
+        Uint32 delta;
+        if (!getVarint(p, end, delta) || p == end) break;
+        tick += delta;
+        ReplayedInput input;
+        input.tick = tick;
+        SDL_zero(input.event);
+        int type = *p++;
+        int f[3] = {0, 0, 0};
+        int fieldCount = type == INPUT_MOUSE_DOWN || type == INPUT_WHEEL || type == INPUT_PAN ? 3
+                       : type == INPUT_KEY || type == INPUT_GOAL ? 2 : type == INPUT_LAYOUT ? 1 : 0;
+        bool ok = true;
+        for (int i = 0; i < fieldCount && ok; ++i) ok = getZigzag(p, end, f[i]);
+        SDL_Event& ev = input.event;
+        switch (type) {
+        case INPUT_MOUSE_DOWN:
+            ev.type = SDL_MOUSEBUTTONDOWN;
+            ev.button.button = (Uint8)f[0];
+            ev.button.x = f[1];
+            ev.button.y = f[2];
+            break;
+        case INPUT_WHEEL:
+            ev.type = SDL_MOUSEWHEEL;
+            ev.wheel.y = f[0];
+            input.cursor = {f[1], f[2]};
+            break;
+        case INPUT_PAN:
+            ev.type = SDL_MOUSEMOTION;
+            ev.motion.xrel = f[0];
+            ev.motion.yrel = f[1];
+            ev.motion.state = (Uint32)f[2];
+            break;
+        case INPUT_KEY:
+            ev.type = SDL_KEYDOWN;
+            ev.key.keysym.sym = f[0];
+            ev.key.keysym.mod = (Uint16)f[1];
+            break;
+        case INPUT_QUIT:
+            ev.type = SDL_QUIT;
+            break;
+        case INPUT_LAYOUT: {
+            Uint32 length;
+            ok = ok && getVarint(p, end, length) && length <= (size_t)(end - p);
+            ok = ok && parseLayoutBinary(std::vector<unsigned char>(p, p + (ok ? length : 0)), input.layout);
+            if (ok) p += length;
+            ev.type = SDL_USEREVENT;
+            ev.user.code = REPLAY_LAYOUT;
+            input.replan = f[0] != 0;
+            break;
+        }
+        case INPUT_GOAL:
+            ev.type = SDL_USEREVENT;
+            ev.user.code = REPLAY_GOAL;
+            input.goal = {f[0], f[1]};
+            break;
+        default:
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Input log " << filename << " is truncated or corrupt; replaying what was read" << std::endl;
+            break;
+        }
+        replay.inputs.push_back(std::move(input));
+    }
+    replay.active = true;
+    replay.finished = replay.inputs.empty();
+    std::cout << "Replaying " << replay.inputs.size() << " inputs from " << filename << std::endl;
+    return true;
+}
+
+// Live SDL events, except that during a replay user input comes from the log instead
+bool pollInput(SDL_Event& e) {
+    while (SDL_PollEvent(&e)) {
+        if (!isRecordedInput(e)) return true;
+        if (inputReplay.active && e.type != SDL_QUIT) continue; // Closing the window still ends a replay
+        if (e.type == SDL_MOUSEWHEEL) SDL_GetMouseState(&wheelCursor.x, &wheelCursor.y);
+        // Events are stamped in SDL_GetTicks milliseconds; count the time they sat in the queue
+        Uint64 now = SDL_GetPerformanceCounter();
+        Uint64 queued = (Uint64)(SDL_GetTicks() - e.common.timestamp) * SDL_GetPerformanceFrequency() / 1000;
+        inputQueuedAt = now - std::min(now, queued);
+        recordInput(e);
+        return true;
+    }
+
+    InputReplay& replay = inputReplay;
+    if (!replay.active || replay.inputs.empty() || replay.inputs.front().tick > simTick) return false;
+    ReplayedInput& input = replay.inputs.front();
+    e = input.event;
+    inputQueuedAt = SDL_GetPerformanceCounter();
+    if (e.type == SDL_MOUSEWHEEL) {
+        wheelCursor = input.cursor;
+    } else if (e.type == SDL_USEREVENT && e.user.code == REPLAY_GOAL) {
+        replay.goal = input.goal;
+    } else if (e.type == SDL_USEREVENT) {
+        replay.layout = std::move(input.layout);
+        replay.replan = input.replan;
+    }
+    replay.inputs.pop_front();
+    replay.finished = replay.inputs.empty();
+    return true;
+}
+
+// User input that changes the simulation or the view; window and render events are not recorded
+bool isRecordedInput(const SDL_Event& e) {
+    return e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEWHEEL || e.type == SDL_KEYDOWN || e.type == SDL_QUIT ||
+           (e.type == SDL_MOUSEMOTION && (e.motion.state & SDL_BUTTON_MMASK));
+}
+
+// Events the loop acts on or that invalidate the window; hovering and focus changes draw nothing
+bool changesFrame(const SDL_Event& e) {
+    switch (e.type) {
+    case SDL_MOUSEMOTION:
+        return (e.motion.state & SDL_BUTTON_MMASK) != 0;
+    case SDL_WINDOWEVENT:
+        return e.window.event == SDL_WINDOWEVENT_EXPOSED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED ||
+               e.window.event == SDL_WINDOWEVENT_RESTORED;
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEWHEEL:
+    case SDL_KEYDOWN:
+    case SDL_USEREVENT:
+    case SDL_RENDER_TARGETS_RESET:
+    case SDL_RENDER_DEVICE_RESET:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void recordInput(const SDL_Event& e) {
+    if (!inputRecorder.active) return;
+    if (e.type == SDL_MOUSEBUTTONDOWN)
+        writeInputRecord(INPUT_MOUSE_DOWN, {e.button.button, e.button.x, e.button.y}, {});
+    else if (e.type == SDL_MOUSEWHEEL)
+        writeInputRecord(INPUT_WHEEL, {e.wheel.y, wheelCursor.x, wheelCursor.y}, {});
+    else if (e.type == SDL_MOUSEMOTION)
+        writeInputRecord(INPUT_PAN, {e.motion.xrel, e.motion.yrel, (int)e.motion.state}, {});
+    else if (e.type == SDL_KEYDOWN)
+        writeInputRecord(INPUT_KEY, {e.key.keysym.sym, e.key.keysym.mod}, {});
+    else if (e.type == SDL_QUIT)
+        writeInputRecord(INPUT_QUIT, {}, {});
+}
+
+void recordLayout(bool replan) {
+    if (!inputRecorder.active) return;
+    std::vector<unsigned char> encoded;
+    encodeLayout(warehouseGrid, LAYOUT_FILE, encoded);
+    writeInputRecord(INPUT_LAYOUT, {replan ? 1 : 0}, encoded);
+}
+
+void recordGoal(Point goal) {
+    if (inputRecorder.active) writeInputRecord(INPUT_GOAL, {goal.x, goal.y}, {});
+}
+
+void writeInputRecord(InputType type, const std::vector<int>& fields, const std::vector<unsigned char>& payload) {
+    InputRecorder& rec = inputRecorder;
+    std::vector<unsigned char> out;
+    putVarint(out, (Uint32)(simTick - rec.lastTick));
+    rec.lastTick = simTick;
+    out.push_back(type);
+    for (int field : fields) putZigzag(out, field);
+    if (type == INPUT_LAYOUT) {
+        putVarint(out, (Uint32)payload.size());
+        out.insert(out.end(), payload.begin(), payload.end());
+    }
+    rec.stream.write((const char*)out.data(), (std::streamsize)out.size());
+}
+
+// Signed values as varints: 0, -1, 1, -2, ... map to 0, 1, 2, 3, ...
+void putZigzag(std::vector<unsigned char>& out, int value) {
+    putVarint(out, ((Uint32)value << 1) ^ (Uint32)(value >> 31));
+}
+
+bool getZigzag(const unsigned char*& p, const unsigned char* end, int& value) {
+    Uint32 raw;
+    if (!getVarint(p, end, raw)) return false;
+    value = (int)(raw >> 1) ^ -(int)(raw & 1);
+    return true;
+}
+
+bool startPathExport(const std::string& filename) {
+    PathExporter& exporter = pathExporter;
+    exporter.file = std::fopen(filename.c_str(), "wb");
+    if (!exporter.file) {
+        std::cerr << "Error opening path export " << filename << std::endl;
+        return false;
+    }
+    exporter.buffer.reserve(PATH_EXPORT_BUFFER);
+    exporter.buffer.assign(PATH_LOG_MAGIC, PATH_LOG_MAGIC + 4);
+    putLE(exporter.buffer, PATH_LOG_VERSION, 2);
+    return true;
+}
+
+void stopPathExport() {
+    PathExporter& exporter = pathExporter;
+    if (!exporter.file) return;
+    flushPathExport();
+    std::fclose(exporter.file);
+    exporter.file = nullptr;
+    std::cout << "Exported " << exporter.paths << " paths" << std::endl;
+}
+
+void exportPath(Point start, Point goal, const std::vector<Point>& path) {
+    PathExporter& exporter = pathExporter;
+    std::vector<unsigned char>& record = exporter.record;
+    record.clear();
+    record.push_back((useAStar ? PATH_FLAG_ASTAR : 0) | (path.empty() && !(start == goal) ? 0 : PATH_FLAG_FOUND));
+    putZigzag(record, start.x);
+    putZigzag(record, start.y);
+    putZigzag(record, goal.x);
+    putZigzag(record, goal.y);
+    putVarint(record, (Uint32)path.size());
+
+    // Paths are 4-connected, so each move is one of four unit steps
+    size_t packed = record.size();
+    record.resize(packed + (path.size() + 3) / 4, 0);
+    Point previous = start;
+    for (size_t i = 0; i < path.size(); ++i) {
+        int dx = path[i].x - previous.x, dy = path[i].y - previous.y;
+        unsigned char direction = dy < 0 ? 0 : dx > 0 ? 1 : dy > 0 ? 2 : 3;
+        record[packed + i / 4] |= (unsigned char)(direction << (2 * (i % 4)));
+        previous = path[i];
+    }
+
+    putVarint(exporter.buffer, (Uint32)record.size());
+    exporter.buffer.insert(exporter.buffer.end(), record.begin(), record.end());
+    ++exporter.paths;
+    if (exporter.buffer.size() >= PATH_EXPORT_BUFFER) flushPathExport();
+}
+
+void flushPathExport() {
+    PathExporter& exporter = pathExporter;
+    if (std::fwrite(exporter.buffer.data(), 1, exporter.buffer.size(), exporter.file) != exporter.buffer.size()) {
+        std::cerr << "Error writing path export" << std::endl;
+    }
+    exporter.buffer.clear();
+}
+
+#ifdef WAREHOUSE_BENCH
+// Heap accounting for the benchmark build: every allocation carries its size in a header
+std::atomic<size_t> heapBytes{0};
+std::atomic<size_t> heapPeakBytes{0};
+const size_t HEAP_HEADER = alignof(std::max_align_t);
+
+void* operator new(size_t size) {
+    unsigned char* block = (unsigned char*)std::malloc(size + HEAP_HEADER);
+    if (!block) throw std::bad_alloc();
+    *(size_t*)block = size;
+    size_t now = heapBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = heapPeakBytes.load(std::memory_order_relaxed);
+    while (now > peak && !heapPeakBytes.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+    return block + HEAP_HEADER;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    unsigned char* block = (unsigned char*)p - HEAP_HEADER;
+    heapBytes.fetch_sub(*(size_t*)block, std::memory_order_relaxed);
+    std::free(block);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+#endif
+
+std::vector<Point> countBfs(Point start, Point end, SearchStatsTracer& tracer) {
+    return bfsSearch(start, end, tracer);
+}
+
+std::vector<Point> countAStar(Point start, Point end, SearchStatsTracer& tracer) {
+    return aStarSearch(start, end, tracer);
+}
+
+// Usage: bench [--seed N] [--queries N] [--sizes 64,256,...] [--out FILE.json]
+int runBenchmarks(int argc, char* argv[]) {
+    unsigned seed = 1;
+    int queryCount = 100;
+    std::vector<int> sizes = {64, 256, 512};
+    std::string outPath;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--seed") {
+            seed = (unsigned)std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (arg == "--queries") {
+            queryCount = std::max(1, std::atoi(argv[i + 1]));
+        } else if (arg == "--sizes") {
+            sizes.clear();
+            std::istringstream list(argv[i + 1]);
+            std::string size;
+            while (std::getline(list, size, ',')) {
+                if (std::atoi(size.c_str()) > 0) sizes.push_back(std::atoi(size.c_str()));
+            }
+        } else if (arg == "--out") {
+            outPath = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--seed N] [--queries N] [--sizes 64,256,...] [--out FILE.json]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    // New engines go here; each needs a plain entry point and a stats-tracer one
+    const BenchEngine engines[] = {
+        {"bfs", findPath, countBfs},
+        {"astar", findPathA, countAStar},
+    };
+
+    useCongestionCost = false;
+    std::ostringstream json;
+    json << "{\n  \"seed\": " << seed << ",\n  \"queries\": " << queryCount << ",\n  \"results\": [";
+    bool first = true;
+    for (int size : sizes) {
+        for (int map = BENCH_RANDOM; map <= BENCH_ROOMS; ++map) {
+            generateBenchMap((BenchMap)map, size, seed);
+            std::vector<std::pair<Point, Point>> queries = generateBenchQueries(queryCount, seed);
+            for (const BenchEngine& engine : engines) {
+                BenchResult r = runBenchEngine(engine, queries);
+                json << (first ? "" : ",") << "\n    {\"map\": \"" << BENCH_MAP_NAMES[map] << "\", \"size\": " << size
+                     << ", \"engine\": \"" << engine.name << "\", \"ns_per_query\": " << (long long)r.nsPerQuery
+                     << ", \"expansions_per_query\": " << r.expansionsPerQuery
+                     << ", \"reopened_per_query\": " << r.reopenedPerQuery << ", \"queue_peak\": " << r.queuePeak
+                     << ", \"mean_path_length\": " << r.pathLength << ", \"found\": " << r.found
+                     << ", \"peak_heap_bytes\": " << r.peakHeapBytes << "}";
+                first = false;
+                std::cerr << BENCH_MAP_NAMES[map] << " " << size << " " << engine.name << ": "
+                          << (long long)r.nsPerQuery << " ns/query" << std::endl;
+            }
+        }
+    }
+    json << "\n  ],\n  \"peak_rss_kb\": " << peakResidentKb() << "\n}\n";
+
+    if (outPath.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(outPath);
+        out << json.str();
+        if (!out) {
+            std::cerr << "Error writing " << outPath << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void generateBenchMap(BenchMap type, int size, unsigned seed) {
+    warehouseGrid = Grid(size, size);
+    Grid& g = warehouseGrid;
+    std::mt19937 rng(seed * 4 + type);
+
+    if (type == BENCH_RANDOM) {
+        // 30% obstacles, uniformly scattered
+        std::bernoulli_distribution obstacle(0.3);
+        for (auto& cell : g.cells) cell = obstacle(rng);
+    } else if (type == BENCH_MAZE) {
+        // Perfect maze: passages on odd coordinates, carved by an iterative depth-first search
+        std::fill(g.cells.begin(), g.cells.end(), 1);
+        std::vector<Point> stack = {{1, 1}};
+        g[1][1] = 0;
+        const int dx[] = {0, 2, 0, -2};
+        const int dy[] = {-2, 0, 2, 0};
+        while (!stack.empty()) {
+            Point cell = stack.back();
+            int options[4], count = 0;
+            for (int i = 0; i < 4; ++i) {
+                int nx = cell.x + dx[i], ny = cell.y + dy[i];
+                if (nx > 0 && ny > 0 && nx < size - 1 && ny < size - 1 && g[ny][nx]) options[count++] = i;
+            }
+            if (count == 0) {
+                stack.pop_back();
+                continue;
+            }
+            int i = options[rng() % count];
+            g[cell.y + dy[i] / 2][cell.x + dx[i] / 2] = 0;
+            g[cell.y + dy[i]][cell.x + dx[i]] = 0;
+            stack.push_back({cell.x + dx[i], cell.y + dy[i]});
+        }
+    } else if (type == BENCH_RACKS) {
+        // Two-deep racks between three-wide aisles, with a cross aisle every 20 rows
+        for (int y = 1; y < size - 1; ++y) {
+            if (y % 20 < 2) continue;
+            for (int x = 2; x < size - 2; ++x) g[y][x] = x % 5 == 2 || x % 5 == 3;
+        }
+    } else {
+        // 16x16 rooms; every wall between neighbouring rooms has a two-cell door at a random spot
+        const int room = 16;
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) g[y][x] = (x % room == 0 || y % room == 0) && x > 0 && y > 0;
+        }
+        std::uniform_int_distribution<int> door(1, room - 3);
+        for (int y = 0; y < size; y += room) {
+            for (int x = 0; x < size; x += room) {
+                int d = door(rng);
+                for (int k = 0; k < 2; ++k) {
+                    if (x > 0 && y + d + k < size) g[y + d + k][x] = 0;
+                    if (y > 0 && x + d + k < size) g[y][x + d + k] = 0;
+                }
+            }
+        }
+    }
+    markGridDirty();
+}
+
+// Start/goal pairs on free cells, from their own seeded stream so every engine sees the same set
+std::vector<std::pair<Point, Point>> generateBenchQueries(int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> col(0, warehouseGrid.cols - 1), row(0, warehouseGrid.rows - 1);
+    auto freeCell = [&] {
+        for (;;) {
+            Point p = {col(rng), row(rng)};
+            if (isValidGridPosition(p.x, p.y)) return p;
+        }
+    };
+    std::vector<std::pair<Point, Point>> queries;
+    for (int i = 0; i < count; ++i) {
+        Point start = freeCell();
+        queries.push_back({start, freeCell()});
+    }
+    return queries;
+}
+
+// Timed pass through the real entry point, then a pass with the stats tracer for expansions
+BenchResult runBenchEngine(const BenchEngine& engine, const std::vector<std::pair<Point, Point>>& queries) {
+    BenchResult r;
+    size_t length = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (const auto& q : queries) {
+        std::vector<Point> path = engine.plan(q.first, q.second);
+        length += path.size();
+        r.found += !path.empty() || q.first == q.second;
+    }
+    auto end = std::chrono::steady_clock::now();
+    r.nsPerQuery = std::chrono::duration<double, std::nano>(end - begin).count() / queries.size();
+    r.pathLength = r.found ? (double)length / r.found : 0;
+
+    size_t expanded = 0, reopened = 0;
+    for (const auto& q : queries) {
+#ifdef WAREHOUSE_BENCH
+        size_t baseline = heapBytes.load();
+        heapPeakBytes.store(baseline);
+#endif
+        SearchStatsTracer tracer;
+        engine.count(q.first, q.second, tracer);
+        expanded += tracer.stats.expanded;
+        reopened += tracer.stats.reopened;
+        r.queuePeak = std::max(r.queuePeak, tracer.stats.queuePeak);
+#ifdef WAREHOUSE_BENCH
+        r.peakHeapBytes = std::max(r.peakHeapBytes, heapPeakBytes.load() - baseline);
+#endif
+    }
+    r.expansionsPerQuery = (double)expanded / queries.size();
+    r.reopenedPerQuery = (double)reopened / queries.size();
+    return r;
+}
+
+long long peakResidentKb() {
+#ifdef _WIN32
+    return -1; // Not reported on Windows; peak_heap_bytes covers the planners
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // Kilobytes on Linux
+#endif
+}
+
+void recordSearchStats(bool astar, const SearchStats& stats) {
+    SearchHistogram& h = searchHistograms[astar ? 1 : 0];
+    ++h.queries;
+    ++h.micros[histogramBucket((unsigned long long)(stats.seconds * 1e6))];
+    ++h.expanded[histogramBucket(stats.expanded)];
+    h.queuePeak = std::max(h.queuePeak, stats.queuePeak);
+    h.reopened += stats.reopened;
+    h.last = stats;
+}
+
+// Bucket 0 holds zero, bucket i values in [2^(i-1), 2^i)
+int histogramBucket(unsigned long long value) {
+    int bucket = 0;
+    while (value && bucket < SEARCH_HISTOGRAM_BUCKETS - 1) {
+        value >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+// Upper bound of the bucket holding the q-quantile
+unsigned long long histogramPercentile(const unsigned long long* buckets, unsigned long long count, double q) {
+    unsigned long long rank = (unsigned long long)std::ceil(q * count), seen = 0;
+    for (int i = 0; i < SEARCH_HISTOGRAM_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= rank && seen) return i ? (1ULL << i) - 1 : 0;
+    }
+    return 0;
+}
+
+// HUD line for the current algorithm: the last search, then p50/p99 wall time over all of them
+std::string searchStatsSummary() {
+    const SearchHistogram& h = searchHistograms[useAStar ? 1 : 0];
+    if (!collectSearchStats || !h.queries) return "";
+    const SearchStats& last = h.last;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%s: %zu exp %zu gen %zu reopen  queue %zu  %zu KB  %.2f ms"
+                  "   p50 %.2f  p99 %.2f ms (%llu)",
+                  useAStar ? "A*" : "BFS", last.expanded, last.generated, last.reopened, last.queuePeak,
+                  last.allocationBytes / 1024, last.seconds * 1000,
+                  histogramPercentile(h.micros, h.queries, 0.5) / 1000.0,
+                  histogramPercentile(h.micros, h.queries, 0.99) / 1000.0, h.queries);
+    return line;
+}
+
+int profileStage(int stage) {
+    FrameProfiler& p = frameProfiler;
+    Uint64 now = SDL_GetPerformanceCounter();
+    p.current[p.active] += now - p.stageStart;
+    if (p.active != PROFILE_IDLE && spanTrace.recording.load(std::memory_order_relaxed))
+        traceSpan(PROFILE_STAGE_NAMES[p.active], p.stageStart, now);
+    if (p.active == PROFILE_IDLE) p.frameStart = now;
+    p.stageStart = now;
+    int previous = p.active;
+    p.active = stage;
+    return previous;
+}
+
+// Closes the frame in progress: its stage times go into the ring and the clock idles
+void endProfileFrame() {
+    FrameProfiler& p = frameProfiler;
+    profileStage(PROFILE_IDLE);
+    if (spanTrace.recording.load(std::memory_order_relaxed)) traceSpan("frame", p.frameStart, p.stageStart);
+    std::copy(p.current, p.current + PROFILE_STAGES, p.frames[p.head]);
+    std::fill(p.current, p.current + PROFILE_STAGES + 1, 0);
+    p.head = (p.head + 1) % PROFILE_FRAMES;
+    p.count = std::min(p.count + 1, PROFILE_FRAMES);
+}
+
+// Milliseconds over the recorded frames; PROFILE_STAGES gives the whole frame
+void profilePercentiles(int stage, double& p50, double& p99) {
+    FrameProfiler& p = frameProfiler;
+    p50 = p99 = 0;
+    if (!p.count) return;
+    p.scratch.clear();
+    for (int i = 0; i < p.count; ++i) {
+        const Uint64* frame = p.frames[i];
+        Uint64 ticks = 0;
+        if (stage < PROFILE_STAGES)
+            ticks = frame[stage];
+        else
+            for (int s = 0; s < PROFILE_STAGES; ++s) ticks += frame[s];
+        p.scratch.push_back(ticks);
+    }
+    double msPerTick = 1000.0 / SDL_GetPerformanceFrequency();
+    size_t mid = p.scratch.size() / 2, high = p.scratch.size() * 99 / 100;
+    std::nth_element(p.scratch.begin(), p.scratch.begin() + mid, p.scratch.end());
+    p50 = p.scratch[mid] * msPerTick;
+    std::nth_element(p.scratch.begin(), p.scratch.begin() + high, p.scratch.end());
+    p99 = p.scratch[high] * msPerTick;
+}
+
+// Stacked frame-time graph, oldest frame on the left, with a 60 Hz budget line and p50/p99 per stage
+void renderProfiler() {
+    FrameProfiler& p = frameProfiler;
+    const int graphH = 100;
+    const int panelW = PROFILE_FRAMES + 20, panelH = graphH + 40 + 18 * PROFILE_STAGES;
+    const int left = SCREEN_WIDTH - panelW - 10, top = 150;
+    const int graphX = left + 10, graphBottom = top + 10 + graphH;
+    const double pixelsPerTick = graphH / (PROFILE_GRAPH_MS * SDL_GetPerformanceFrequency() / 1000.0);
+
+    SDL_Rect panel = {left, top, panelW, panelH};
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderFillRect(renderer, &panel);
+
+    for (int i = 0; i < p.count; ++i) {
+        const Uint64* frame = p.frames[(p.head - p.count + i + PROFILE_FRAMES) % PROFILE_FRAMES];
+        int x = graphX + PROFILE_FRAMES - p.count + i;
+        double y = graphBottom;
+        for (int s = 0; s < PROFILE_STAGES && y > graphBottom - graphH; ++s) {
+            double h = frame[s] * pixelsPerTick;
+            int y0 = (int)std::max(y - h, (double)(graphBottom - graphH));
+            if ((int)y > y0) p.bars[s].push_back({x, y0, 1, (int)y - y0});
+            y -= h;
+        }
+    }
+    for (int s = 0; s < PROFILE_STAGES; ++s) {
+        const SDL_Color& c = PROFILE_STAGE_COLORS[s];
+        if (!p.bars[s].empty()) {
+            SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+            SDL_RenderFillRects(renderer, p.bars[s].data(), (int)p.bars[s].size());
+        }
+        p.bars[s].clear();
+    }
+    int budgetY = graphBottom - (int)(graphH * (1000.0 / 60) / PROFILE_GRAPH_MS);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderDrawLine(renderer, graphX, budgetY, graphX + PROFILE_FRAMES - 1, budgetY);
+
+    SDL_Color white = {255, 255, 255, 255};
+    char line[96];
+    double p50, p99;
+    profilePercentiles(PROFILE_STAGES, p50, p99);
+    std::snprintf(line, sizeof(line), "frame  p50 %.2f  p99 %.2f ms", p50, p99);
+    renderText(line, graphX, graphBottom + 8, white);
+    for (int s = 0; s < PROFILE_STAGES; ++s) {
+        int y = graphBottom + 30 + 18 * s;
+        SDL_Rect swatch = {graphX, y + 4, 10, 10};
+        const SDL_Color& c = PROFILE_STAGE_COLORS[s];
+        SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+        SDL_RenderFillRect(renderer, &swatch);
+        profilePercentiles(s, p50, p99);
+        std::snprintf(line, sizeof(line), "%-9s p50 %5.2f  p99 %5.2f", PROFILE_STAGE_NAMES[s], p50, p99);
+        renderText(line, graphX + 16, y, white);
+    }
+}
+
+void traceSpan(const char* name, Uint64 begin, Uint64 end) {
+    TraceBuffer* buffer = localTraceBuffer();
+    if (!buffer->spans.push({name, begin, end})) buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+// The calling thread's buffer: one left behind by an exited thread, or a new one
+TraceBuffer* localTraceBuffer() {
+    TraceBufferOwner& owner = traceBufferOwner;
+    if (owner.buffer) return owner.buffer;
+    std::lock_guard<std::mutex> lock(spanTrace.mutex);
+    for (auto& buffer : spanTrace.buffers) {
+        bool expected = false;
+        if (buffer->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            owner.buffer = buffer.get();
+            break;
+        }
+    }
+    if (!owner.buffer) {
+        spanTrace.buffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer));
+        owner.buffer = spanTrace.buffers.back().get();
+        owner.buffer->owned = true;
+        owner.buffer->tid = (int)spanTrace.buffers.size();
+    }
+    owner.buffer->threadName = traceThreadName;
+    return owner.buffer;
+}
+
+// Spans left over from an earlier recording are discarded
+void startTrace() {
+    {
+        std::lock_guard<std::mutex> lock(spanTrace.mutex);
+        TraceSpan span;
+        for (auto& buffer : spanTrace.buffers) {
+            while (buffer->spans.pop(span)) {}
+            buffer->dropped = 0;
+        }
+        spanTrace.origin = SDL_GetPerformanceCounter();
+    }
+    spanTrace.recording = true;
+}
+
+void stopTrace() {
+    spanTrace.recording = false;
+    flushTrace();
+}
+
+// Drains every thread's buffer into spanTrace.path as Chrome trace-event JSON ("X" complete
+// events, timestamps in microseconds since the recording started)
+bool flushTrace() {
+    std::lock_guard<std::mutex> lock(spanTrace.mutex);
+    FILE* out = std::fopen(spanTrace.path.c_str(), "w");
+    if (!out) {
+        std::cerr << "Error: could not write trace to " << spanTrace.path << std::endl;
+        return false;
+    }
+
+    const double microsPerTick = 1e6 / SDL_GetPerformanceFrequency();
+    size_t spans = 0, dropped = 0;
+    std::fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    for (auto& buffer : spanTrace.buffers) {
+        std::fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                     "\"args\": {\"name\": \"%s\"}}", first ? "" : ",\n", buffer->tid, buffer->threadName);
+        first = false;
+        TraceSpan span;
+        while (buffer->spans.pop(span)) {
+            Uint64 begin = std::max(span.begin, spanTrace.origin), end = std::max(span.end, begin);
+            std::fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                         span.name, buffer->tid, (begin - spanTrace.origin) * microsPerTick, (end - begin) * microsPerTick);
+            ++spans;
+        }
+        dropped += buffer->dropped.exchange(0);
+    }
+    std::fprintf(out, "\n]}\n");
+    bool ok = std::fclose(out) == 0;
+    if (!ok) std::cerr << "Error: could not write trace to " << spanTrace.path << std::endl;
+    std::cerr << "Trace: " << spans << " spans written to " << spanTrace.path;
+    if (dropped) std::cerr << " (" << dropped << " dropped, buffers full)";
+    std::cerr << std::endl;
+    return ok;
+}
+
+void recordLatency(LatencyMetric metric, Uint64 beginCounter) {
+    Uint64 elapsed = SDL_GetPerformanceCounter() - beginCounter;
+    recordLatencyNs(latencyHistograms[metric], (unsigned long long)((double)elapsed * 1e9 / SDL_GetPerformanceFrequency()));
+}
+
+void recordLatencyNs(LatencyHistogram& h, unsigned long long ns) {
+    h.counts[latencyBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    h.samples.fetch_add(1, std::memory_order_relaxed);
+    h.sum.fetch_add(ns, std::memory_order_relaxed);
+    unsigned long long seen = h.max.load(std::memory_order_relaxed);
+    while (ns > seen && !h.max.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {}
+}
+
+// Values below 16 get a bucket each; above that, the top five significant bits pick the bucket
+int latencyBucket(unsigned long long ns) {
+    ns = std::min(ns, (1ULL << LATENCY_MAGNITUDES) - 1);
+    if (ns < (unsigned long long)LATENCY_SUB_BUCKETS) return (int)ns;
+    int magnitude = 63;
+    while (!(ns >> magnitude)) --magnitude;
+    int shift = magnitude - LATENCY_SUB_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (int)(ns >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+// Largest value that lands in the bucket
+unsigned long long latencyBucketHighest(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    unsigned long long lowest = (unsigned long long)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+    return lowest + (1ULL << shift) - 1;
+}
+
+void mergeLatency(LatencyHistogram& into, const LatencyHistogram& from) {
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        unsigned long long n = from.counts[i].load(std::memory_order_relaxed);
+        if (n) into.counts[i].fetch_add(n, std::memory_order_relaxed);
+    }
+    into.samples.fetch_add(from.samples.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    into.sum.fetch_add(from.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    unsigned long long fromMax = from.max.load(std::memory_order_relaxed);
+    unsigned long long seen = into.max.load(std::memory_order_relaxed);
+    while (fromMax > seen && !into.max.compare_exchange_weak(seen, fromMax, std::memory_order_relaxed)) {}
+}
+
+// Highest value equivalent to the q-quantile's bucket, capped at the recorded maximum
+unsigned long long latencyPercentile(const LatencyHistogram& h, double q) {
+    unsigned long long samples = h.samples.load(std::memory_order_relaxed);
+    if (!samples) return 0;
+    unsigned long long rank = std::max(1ULL, (unsigned long long)std::ceil(q * samples)), seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += h.counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank) return std::min(latencyBucketHighest(i), h.max.load(std::memory_order_relaxed));
+    }
+    return h.max.load(std::memory_order_relaxed);
+}
+
+// Text dump: a summary line and percentiles per metric, then its non-empty buckets as
+// "highest_ns count cumulative_fraction" rows. The batch queries are also merged into one.
+bool dumpLatencyHistograms(const std::string& filename) {
+    std::ofstream ofs(filename);
+    if (!ofs) {
+        std::cerr << "Error writing latency histograms to " << filename << std::endl;
+        return false;
+    }
+
+    LatencyHistogram batch;
+    mergeLatency(batch, latencyHistograms[LATENCY_BATCH_BFS]);
+    mergeLatency(batch, latencyHistograms[LATENCY_BATCH_ASTAR]);
+    const LatencyHistogram* histograms[LATENCY_METRICS + 1];
+    const char* names[LATENCY_METRICS + 1];
+    for (int m = 0; m < LATENCY_METRICS; ++m) {
+        histograms[m] = &latencyHistograms[m];
+        names[m] = LATENCY_METRIC_NAMES[m];
+    }
+    histograms[LATENCY_METRICS] = &batch;
+    names[LATENCY_METRICS] = "batch_query_all";
+
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999, 0.9999};
+    char line[160];
+    for (int m = 0; m <= LATENCY_METRICS; ++m) {
+        const LatencyHistogram& h = *histograms[m];
+        unsigned long long samples = h.samples.load();
+        if (!samples) continue;
+        std::snprintf(line, sizeof(line), "%s: %llu samples, mean %.1f us, max %.1f us\n", names[m], samples,
+                      (double)h.sum.load() / samples / 1000, h.max.load() / 1000.0);
+        ofs << line;
+        for (double q : quantiles) {
+            std::snprintf(line, sizeof(line), "  p%g %.1f us", q * 100, latencyPercentile(h, q) / 1000.0);
+            ofs << line;
+        }
+        ofs << "\n";
+        unsigned long long seen = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+            unsigned long long n = h.counts[i].load();
+            if (!n) continue;
+            seen += n;
+            std::snprintf(line, sizeof(line), "  %llu %llu %.6f\n", latencyBucketHighest(i), n, (double)seen / samples);
+            ofs << line;
+        }
+        ofs << "\n";
+    }
+    std::cerr << "Latency histograms written to " << filename << std::endl;
+    return true;
 }